@@ -0,0 +1,1255 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fake-xorg.h"
+#include <xkbsrv.h>
+#include <stdarg.h>
+#include <poll.h>
+#include <time.h>
+#include <dlfcn.h>
+
+/*****************************************************************************
+ * The server as far as the driver sees it. Only what a single threaded
+ * program replaying one tablet needs is there: options, devices and their
+ * properties, timers and work procedures. Everything posted is counted,
+ * handed to fakeEventHook and written to fakeEventLog, one line per event.
+ ****************************************************************************/
+
+FILE* fakeEventLog;
+void (*fakeEventHook)(const FakeEvent* ev);
+unsigned long fakeEventCount[FAKE_EVENT_TYPES];
+unsigned long fakeAllocCount;
+int fakeVerbose;
+FakeSerial* fakeSerial;
+
+ScreenInfo screenInfo;
+DDXPointRec dixScreenOrigins[MAXSCREENS];
+ClientPtr serverClient;
+
+typedef struct _FakeOption
+{
+	struct _FakeOption* next;
+	char* name;
+	char* value;
+} FakeOption;
+
+typedef struct _FakeProperty
+{
+	struct _FakeProperty* next;
+	Atom name;
+	Bool deletable;
+	XIPropertyValueRec value;
+} FakeProperty;
+
+/* the server's DeviceIntRec plus what we keep about the device */
+typedef struct
+{
+	DeviceIntRec dev;       /* first, DeviceIntPtrs are cast to this */
+	FakeProperty* props;
+	int (*setProperty)(DeviceIntPtr dev, Atom property,
+		XIPropertyValuePtr prop, BOOL checkonly);
+	int (*getProperty)(DeviceIntPtr dev, Atom property);
+	KeySymsRec keySyms;     /* from XkbApplyMappingChange */
+} FakeDevice;
+
+struct _OsTimerRec
+{
+	struct _OsTimerRec* next;
+	CARD32 expires;
+	OsTimerCallback callback;
+	pointer arg;
+};
+
+typedef struct _FakeHandler
+{
+	struct _FakeHandler* next;
+	int fd;
+	InputHandlerProc proc;
+	pointer data;
+} FakeHandler;
+
+typedef struct _FakeBlockHandler
+{
+	struct _FakeBlockHandler* next;
+	BlockHandlerProcPtr block;
+	WakeupHandlerProcPtr wakeup;
+	pointer data;
+} FakeBlockHandler;
+
+typedef struct _FakeWorkProc
+{
+	struct _FakeWorkProc* next;
+	Bool (*function)(ClientPtr client, pointer closure);
+	pointer closure;
+} FakeWorkProc;
+
+#define FAKE_MAX_ENABLED 16
+
+static LocalDevicePtr fakeInputDevs;
+static LocalDevicePtr fakeEnabled[FAKE_MAX_ENABLED];
+static InputDriverPtr fakeDriver;
+static OsTimerPtr fakeTimers;
+static FakeHandler* fakeHandlers;
+static FakeWorkProc* fakeWorkProcs;
+static FakeBlockHandler* fakeBlockHandlers;
+static char** fakeAtoms;
+static int fakeNumAtoms;
+static Bool fakeClockFrozen;
+static int64_t fakeClockUsecs;
+
+/*****************************************************************************
+ * Memory and messages
+ ****************************************************************************/
+
+pointer Xalloc(unsigned long amount)
+{
+	fakeAllocCount++;
+	return malloc(amount);
+}
+
+pointer Xcalloc(unsigned long amount)
+{
+	fakeAllocCount++;
+	return calloc(1, amount);
+}
+
+pointer Xrealloc(pointer ptr, unsigned long amount)
+{
+	fakeAllocCount++;
+	return realloc(ptr, amount);
+}
+
+void Xfree(pointer ptr)
+{
+	free(ptr);
+}
+
+char* Xstrdup(const char* s)
+{
+	if (!s)
+		return NULL;
+	fakeAllocCount++;
+	return strdup(s);
+}
+
+void xf86Msg(MessageType type, const char* format, ...)
+{
+	va_list args;
+	const char* prefix;
+
+	switch (type)
+	{
+		case X_ERROR: prefix = "(EE) "; break;
+		case X_WARNING: prefix = "(WW) "; break;
+		default:
+			if (!fakeVerbose)
+				return;
+			prefix = "(II) ";
+			break;
+	}
+
+	fputs(prefix, stderr);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+/*****************************************************************************
+ * Options
+ ****************************************************************************/
+
+static FakeOption* fakeOptionFind(pointer list, const char* name)
+{
+	FakeOption* opt;
+
+	for (opt = list; opt; opt = opt->next)
+		if (!xf86NameCmp(opt->name, name))
+			return opt;
+	return NULL;
+}
+
+pointer fakeOptionAdd(pointer list, const char* name, const char* value)
+{
+	FakeOption* head = list;
+	FakeOption* opt = fakeOptionFind(head, name);
+	FakeOption** last;
+
+	if (opt)
+	{
+		xfree(opt->value);
+		opt->value = xstrdup(value);
+		return list;
+	}
+
+	opt = xcalloc(1, sizeof(FakeOption));
+	opt->name = xstrdup(name);
+	opt->value = xstrdup(value);
+
+	/* keep the order they were given in */
+	for (last = &head; *last; last = &(*last)->next)
+		;
+	*last = opt;
+	return head;
+}
+
+void fakeOptionFree(pointer list)
+{
+	FakeOption* opt = list;
+	FakeOption* next;
+
+	for (; opt; opt = next)
+	{
+		next = opt->next;
+		xfree(opt->name);
+		xfree(opt->value);
+		xfree(opt);
+	}
+}
+
+/* names compare ignoring case, blanks and underscores */
+int xf86NameCmp(const char* s1, const char* s2)
+{
+	for (;;)
+	{
+		while (*s1 == '_' || *s1 == ' ' || *s1 == '\t')
+			s1++;
+		while (*s2 == '_' || *s2 == ' ' || *s2 == '\t')
+			s2++;
+		if (!*s1 || !*s2 || tolower(*s1) != tolower(*s2))
+			return tolower(*s1) - tolower(*s2);
+		s1++;
+		s2++;
+	}
+}
+
+char* xf86FindOptionValue(pointer options, const char* name)
+{
+	FakeOption* opt = fakeOptionFind(options, name);
+
+	return opt ? opt->value : NULL;
+}
+
+char* xf86SetStrOption(pointer optlist, const char* name, char* deflt)
+{
+	char* value = xf86FindOptionValue(optlist, name);
+
+	return xstrdup(value ? value : deflt);
+}
+
+char* xf86CheckStrOption(pointer optlist, const char* name, char* deflt)
+{
+	return xf86SetStrOption(optlist, name, deflt);
+}
+
+int xf86SetIntOption(pointer optlist, const char* name, int deflt)
+{
+	char* value = xf86FindOptionValue(optlist, name);
+	char* end;
+	long n;
+
+	if (!value)
+		return deflt;
+
+	n = strtol(value, &end, 0);
+	if (end == value || *end)
+	{
+		xf86Msg(X_ERROR, "Option \"%s\" requires an integer value\n",
+			name);
+		return deflt;
+	}
+	return n;
+}
+
+int xf86SetBoolOption(pointer optlist, const char* name, int deflt)
+{
+	static const char* on[] = { "1", "on", "true", "yes", NULL };
+	static const char* off[] = { "0", "off", "false", "no", NULL };
+	char* value = xf86FindOptionValue(optlist, name);
+	int i;
+
+	if (!value)
+		return deflt;
+
+	/* a bare option means on */
+	if (!*value)
+		return TRUE;
+
+	for (i = 0; on[i]; i++)
+	{
+		if (!xf86NameCmp(value, on[i]))
+			return TRUE;
+		if (!xf86NameCmp(value, off[i]))
+			return FALSE;
+	}
+
+	xf86Msg(X_ERROR, "Option \"%s\" requires a boolean value\n", name);
+	return deflt;
+}
+
+pointer xf86ReplaceStrOption(pointer optlist, const char* name,
+	const char* val)
+{
+	return fakeOptionAdd(optlist, name, val);
+}
+
+pointer xf86ReplaceIntOption(pointer optlist, const char* name,
+	const int val)
+{
+	char tmp[16];
+
+	snprintf(tmp, sizeof(tmp), "%d", val);
+	return fakeOptionAdd(optlist, name, tmp);
+}
+
+pointer xf86AddNewOption(pointer head, const char* name, const char* val)
+{
+	return fakeOptionAdd(head, name, val);
+}
+
+pointer xf86NextOption(pointer list)
+{
+	return list ? ((FakeOption*)list)->next : NULL;
+}
+
+char* xf86OptionName(pointer opt)
+{
+	return opt ? ((FakeOption*)opt)->name : NULL;
+}
+
+char* xf86OptionValue(pointer opt)
+{
+	return opt ? ((FakeOption*)opt)->value : NULL;
+}
+
+/* a copy of the configured options, then the extra ones, then the
+ * defaults of those not set yet */
+void xf86CollectInputOptions(InputInfoPtr pInfo, const char** defaultOpts,
+	pointer extraOpts)
+{
+	pointer list = NULL;
+	FakeOption* opt;
+
+	if (pInfo->conf_idev)
+		for (opt = pInfo->conf_idev->commonOptions; opt; opt = opt->next)
+			list = fakeOptionAdd(list, opt->name, opt->value);
+
+	for (opt = extraOpts; opt; opt = opt->next)
+		list = fakeOptionAdd(list, opt->name, opt->value);
+
+	for (; defaultOpts && defaultOpts[0]; defaultOpts += 2)
+		if (!fakeOptionFind(list, defaultOpts[0]))
+			list = fakeOptionAdd(list, defaultOpts[0],
+				defaultOpts[1]);
+
+	pInfo->options = list;
+}
+
+void xf86ProcessCommonOptions(InputInfoPtr pInfo, pointer options)
+{
+}
+
+/*****************************************************************************
+ * Input devices
+ ****************************************************************************/
+
+void xf86AddInputDriver(InputDriverPtr driver, pointer module, int flags)
+{
+	fakeDriver = driver;
+}
+
+InputInfoPtr xf86FirstLocalDevice(void)
+{
+	return fakeInputDevs;
+}
+
+InputInfoPtr xf86AllocateInput(InputDriverPtr drv, int flags)
+{
+	InputInfoPtr local = xcalloc(1, sizeof(InputInfoRec));
+	InputInfoPtr* last;
+
+	if (!local)
+		return NULL;
+
+	local->drv = drv;
+	local->fd = -1;
+
+	for (last = &fakeInputDevs; *last; last = &(*last)->next)
+		;
+	*last = local;
+	return local;
+}
+
+void xf86DeleteInput(InputInfoPtr pInp, int flags)
+{
+	InputInfoPtr* prev;
+
+	for (prev = &fakeInputDevs; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == pInp)
+		{
+			*prev = pInp->next;
+			break;
+		}
+	}
+
+	fakeOptionFree(pInp->options);
+	xfree(pInp);
+}
+
+LocalDevicePtr fakeDeviceAdd(InputDriverPtr drv, const char* name,
+	pointer options)
+{
+	IDevPtr idev;
+	LocalDevicePtr local;
+	FakeDevice* fake;
+
+	idev = xcalloc(1, sizeof(IDevRec));
+	idev->identifier = xstrdup(name);
+	idev->driver = xstrdup(drv->driverName);
+	idev->commonOptions = options;
+
+	local = drv->PreInit(drv, idev, 0);
+	if (!local)
+		goto fail;
+
+	fake = xcalloc(1, sizeof(FakeDevice));
+	fake->dev.public.devicePrivate = local;
+	fake->dev.name = local->name;
+	local->dev = &fake->dev;
+
+	if (local->device_control(local->dev, DEVICE_INIT) != Success ||
+			local->device_control(local->dev, DEVICE_ON) != Success)
+	{
+		xf86Msg(X_ERROR, "%s: couldn't enable device\n", name);
+		drv->UnInit(drv, local, 0);
+		xfree(fake->dev.proximity);
+		xfree(fake);
+		goto fail;
+	}
+	local->dev->public.on = TRUE;
+
+	return local;
+
+fail:
+	fakeOptionFree(idev->commonOptions);
+	xfree(idev->identifier);
+	xfree(idev->driver);
+	xfree(idev);
+	return NULL;
+}
+
+static void fakeDeviceRemove(LocalDevicePtr local)
+{
+	InputDriverPtr drv = local->drv;
+	IDevPtr idev = local->conf_idev;
+	FakeDevice* fake = (FakeDevice*)local->dev;
+	FakeProperty* prop;
+
+	if (fake)
+	{
+		if (fake->dev.public.on)
+			local->device_control(&fake->dev, DEVICE_OFF);
+		fake->dev.public.on = FALSE;
+		local->device_control(&fake->dev, DEVICE_CLOSE);
+	}
+
+	drv->UnInit(drv, local, 0);
+
+	if (fake)
+	{
+		while ((prop = fake->props))
+		{
+			fake->props = prop->next;
+			xfree(prop->value.data);
+			xfree(prop);
+		}
+		xfree(fake->keySyms.map);
+		xfree(fake->dev.proximity);
+		xfree(fake);
+	}
+
+	if (idev)
+	{
+		fakeOptionFree(idev->commonOptions);
+		xfree(idev->identifier);
+		xfree(idev->driver);
+		xfree(idev);
+	}
+}
+
+void fakeDeviceRemoveAll(void)
+{
+	while (fakeInputDevs)
+		fakeDeviceRemove(fakeInputDevs);
+}
+
+int NewInputDeviceRequest(InputOption* options, DeviceIntPtr* pdev)
+{
+	pointer list = NULL;
+	const char* name = NULL;
+	LocalDevicePtr local;
+
+	if (!fakeDriver)
+		return BadMatch;
+
+	for (; options; options = options->next)
+	{
+		list = fakeOptionAdd(list, options->key, options->value);
+		if (!xf86NameCmp(options->key, "Name"))
+			name = options->value;
+	}
+
+	local = fakeDeviceAdd(fakeDriver, name ? name : fakeDriver->driverName,
+		list);
+	*pdev = local ? local->dev : NULL;
+	return local ? Success : BadMatch;
+}
+
+void DeleteInputDeviceRequest(DeviceIntPtr dev)
+{
+	fakeDeviceRemove(dev->public.devicePrivate);
+}
+
+void xf86AddEnabledDevice(InputInfoPtr pInfo)
+{
+	int i;
+
+	for (i = 0; i < FAKE_MAX_ENABLED; i++)
+	{
+		if (!fakeEnabled[i])
+		{
+			fakeEnabled[i] = pInfo;
+			return;
+		}
+	}
+	xf86Msg(X_ERROR, "%s: too many enabled devices\n", pInfo->name);
+}
+
+void xf86RemoveEnabledDevice(InputInfoPtr pInfo)
+{
+	int i;
+
+	for (i = 0; i < FAKE_MAX_ENABLED; i++)
+	{
+		if (fakeEnabled[i] == pInfo)
+		{
+			memmove(&fakeEnabled[i], &fakeEnabled[i + 1],
+				(FAKE_MAX_ENABLED - i - 1) * sizeof(fakeEnabled[0]));
+			fakeEnabled[FAKE_MAX_ENABLED - 1] = NULL;
+			return;
+		}
+	}
+}
+
+LocalDevicePtr fakeEnabledDevice(int n)
+{
+	return (n >= 0 && n < FAKE_MAX_ENABLED) ? fakeEnabled[n] : NULL;
+}
+
+/*****************************************************************************
+ * Device classes, only what the driver reads back is kept
+ ****************************************************************************/
+
+Bool InitButtonClassDeviceStruct(DeviceIntPtr dev, int numButtons,
+	Atom* labels, CARD8* map)
+{
+	return TRUE;
+}
+
+Bool InitFocusClassDeviceStruct(DeviceIntPtr dev)
+{
+	return TRUE;
+}
+
+Bool InitPtrFeedbackClassDeviceStruct(DeviceIntPtr dev,
+	PtrCtrlProcPtr controlProc)
+{
+	return TRUE;
+}
+
+Bool InitProximityClassDeviceStruct(DeviceIntPtr dev)
+{
+	if (!dev->proximity)
+		dev->proximity = xcalloc(1, sizeof(ProximityClassRec));
+	return dev->proximity != NULL;
+}
+
+Bool InitValuatorClassDeviceStruct(DeviceIntPtr dev, int numAxes,
+	Atom* labels, int numMotionEvents, int mode)
+{
+	return numAxes <= MAX_VALUATORS;
+}
+
+void InitValuatorAxisStruct(DeviceIntPtr dev, int axnum, Atom label,
+	int minval, int maxval, int resolution, int min_res, int max_res)
+{
+}
+
+Bool InitKeyboardDeviceStruct(DeviceIntPtr dev, XkbRMLVOSet* rmlvo,
+	BellProcPtr bell_func, KbdCtrlProcPtr ctrl_func)
+{
+	return TRUE;
+}
+
+Bool InitLedFeedbackClassDeviceStruct(DeviceIntPtr dev,
+	LedCtrlProcPtr controlProc)
+{
+	return TRUE;
+}
+
+int GetMotionHistorySize(void)
+{
+	return 0;
+}
+
+void XkbApplyMappingChange(DeviceIntPtr kbd, KeySymsPtr map,
+	KeyCode first_key, CARD8 num_keys, CARD8* modmap, ClientPtr client)
+{
+	FakeDevice* fake = (FakeDevice*)kbd;
+	int n = (map->maxKeyCode - map->minKeyCode + 1) * map->mapWidth;
+
+	xfree(fake->keySyms.map);
+	fake->keySyms = *map;
+	fake->keySyms.map = xalloc(n * sizeof(KeySym));
+	memcpy(fake->keySyms.map, map->map, n * sizeof(KeySym));
+}
+
+/* the caller frees the map with one xfree, so it's one block */
+KeySymsPtr XkbGetCoreMap(DeviceIntPtr keybd)
+{
+	FakeDevice* fake = (FakeDevice*)keybd;
+	int n = (fake->keySyms.maxKeyCode - fake->keySyms.minKeyCode + 1) *
+		fake->keySyms.mapWidth;
+	KeySymsPtr syms;
+
+	if (!fake->keySyms.map)
+		n = 0;
+	syms = xalloc(sizeof(KeySymsRec) + n * sizeof(KeySym));
+	*syms = fake->keySyms;
+	syms->map = (KeySym*)(syms + 1);
+	if (n)
+		memcpy(syms->map, fake->keySyms.map, n * sizeof(KeySym));
+	else
+		syms->maxKeyCode = syms->minKeyCode - 1;
+	return syms;
+}
+
+/*****************************************************************************
+ * Atoms and device properties
+ ****************************************************************************/
+
+Atom MakeAtom(const char* string, unsigned len, Bool makeit)
+{
+	int i;
+
+	for (i = 0; i < fakeNumAtoms; i++)
+		if (strlen(fakeAtoms[i]) == len &&
+				!strncmp(fakeAtoms[i], string, len))
+			return i + 1;
+
+	if (!makeit)
+		return None;
+
+	fakeAtoms = xrealloc(fakeAtoms, (fakeNumAtoms + 1) * sizeof(char*));
+	fakeAtoms[fakeNumAtoms] = xalloc(len + 1);
+	memcpy(fakeAtoms[fakeNumAtoms], string, len);
+	fakeAtoms[fakeNumAtoms][len] = '\0';
+	return ++fakeNumAtoms;
+}
+
+Bool ValidAtom(Atom atom)
+{
+	return atom != None && atom <= fakeNumAtoms;
+}
+
+Atom XIGetKnownProperty(char* name)
+{
+	return MakeAtom(name, strlen(name), TRUE);
+}
+
+static FakeProperty* fakePropertyFind(DeviceIntPtr dev, Atom property)
+{
+	FakeProperty* prop;
+
+	for (prop = ((FakeDevice*)dev)->props; prop; prop = prop->next)
+		if (prop->name == property)
+			return prop;
+	return NULL;
+}
+
+/* the driver only ever replaces properties, so that's all there is */
+int XIChangeDeviceProperty(DeviceIntPtr dev, Atom property, Atom type,
+	int format, int mode, unsigned long len, pointer value,
+	Bool sendevent)
+{
+	FakeDevice* fake = (FakeDevice*)dev;
+	FakeProperty* prop = fakePropertyFind(dev, property);
+	XIPropertyValueRec new;
+	int rc;
+
+	if (mode != PropModeReplace)
+		return BadImplementation;
+
+	new.type = type;
+	new.format = format;
+	new.size = len;
+	new.data = value;
+
+	if (fake->setProperty)
+	{
+		rc = fake->setProperty(dev, property, &new, TRUE);
+		if (rc == Success)
+			rc = fake->setProperty(dev, property, &new, FALSE);
+		if (rc != Success)
+			return rc;
+	}
+
+	if (!prop)
+	{
+		prop = xcalloc(1, sizeof(FakeProperty));
+		if (!prop)
+			return BadAlloc;
+		prop->name = property;
+		prop->deletable = TRUE;
+		prop->next = fake->props;
+		fake->props = prop;
+	}
+
+	xfree(prop->value.data);
+	prop->value = new;
+	prop->value.data = xalloc(len * format / 8 + 1);
+	memcpy(prop->value.data, value, len * format / 8);
+	return Success;
+}
+
+int XIGetDeviceProperty(DeviceIntPtr dev, Atom property,
+	XIPropertyValuePtr* value)
+{
+	FakeDevice* fake = (FakeDevice*)dev;
+	FakeProperty* prop = fakePropertyFind(dev, property);
+	int rc;
+
+	if (!prop)
+	{
+		*value = NULL;
+		return BadAtom;
+	}
+
+	/* like the server, let the driver update the value first */
+	if (fake->getProperty)
+	{
+		rc = fake->getProperty(dev, property);
+		if (rc != Success)
+		{
+			*value = NULL;
+			return rc;
+		}
+	}
+	*value = &prop->value;
+	return Success;
+}
+
+int XISetDevicePropertyDeletable(DeviceIntPtr dev, Atom property,
+	Bool deletable)
+{
+	FakeProperty* prop = fakePropertyFind(dev, property);
+
+	if (!prop)
+		return BadAtom;
+	prop->deletable = deletable;
+	return Success;
+}
+
+long XIRegisterPropertyHandler(DeviceIntPtr dev,
+	int (*SetProperty)(DeviceIntPtr dev, Atom property,
+		XIPropertyValuePtr prop, BOOL checkonly),
+	int (*GetProperty)(DeviceIntPtr dev, Atom property),
+	int (*DeleteProperty)(DeviceIntPtr dev, Atom property))
+{
+	((FakeDevice*)dev)->setProperty = SetProperty;
+	((FakeDevice*)dev)->getProperty = GetProperty;
+	return 1;
+}
+
+/*****************************************************************************
+ * Posting events
+ ****************************************************************************/
+
+static void fakeEventValuators(FakeEvent* ev, va_list args)
+{
+	int i;
+
+	if (ev->num > MAX_VALUATORS)
+		ev->num = MAX_VALUATORS;
+	for (i = 0; i < ev->num; i++)
+		ev->valuators[i] = va_arg(args, int);
+}
+
+/*****************************************************************************
+ * fakeEventFormat --
+ *   Print an event as it is logged, without the newline. Returns what
+ *   snprintf returns.
+ ****************************************************************************/
+
+int fakeEventFormat(const FakeEvent* ev, char* buf, int size)
+{
+	static const char* names[FAKE_EVENT_TYPES] =
+		{ "motion", "proximity", "button", "key" };
+	int i, len;
+
+	len = snprintf(buf, size, "%s \"%s\"", names[ev->type], ev->dev->name);
+	switch (ev->type)
+	{
+		case FAKE_KEY:
+			return len + snprintf(buf + len, len < size ? size - len : 0,
+				" %d %d", ev->detail, ev->down);
+		case FAKE_BUTTON:
+			len += snprintf(buf + len, len < size ? size - len : 0,
+				" %d %d %d", ev->mode, ev->detail, ev->down);
+			break;
+		default:
+			len += snprintf(buf + len, len < size ? size - len : 0,
+				" %d", ev->mode);
+			break;
+	}
+
+	len += snprintf(buf + len, len < size ? size - len : 0, " %d %d",
+		ev->first, ev->num);
+	for (i = 0; i < ev->num; i++)
+		len += snprintf(buf + len, len < size ? size - len : 0, " %d",
+			ev->valuators[i]);
+	return len;
+}
+
+/* count, hand on and log one event */
+static void fakeEventPost(const FakeEvent* ev)
+{
+	char line[FAKE_EVENT_LINE];
+
+	fakeEventCount[ev->type]++;
+	if (fakeEventHook)
+		fakeEventHook(ev);
+	if (!fakeEventLog)
+		return;
+
+	fakeEventFormat(ev, line, sizeof(line));
+	fprintf(fakeEventLog, "%s\n", line);
+}
+
+void xf86PostMotionEvent(DeviceIntPtr device, int is_absolute,
+	int first_valuator, int num_valuators, ...)
+{
+	FakeEvent ev = { FAKE_MOTION, device, is_absolute ? 1 : 0, 0, 0,
+		first_valuator, num_valuators };
+	va_list args;
+
+	va_start(args, num_valuators);
+	fakeEventValuators(&ev, args);
+	va_end(args);
+	fakeEventPost(&ev);
+}
+
+void xf86PostProximityEvent(DeviceIntPtr device, int is_in,
+	int first_valuator, int num_valuators, ...)
+{
+	FakeEvent ev = { FAKE_PROXIMITY, device, is_in, 0, 0,
+		first_valuator, num_valuators };
+	va_list args;
+
+	va_start(args, num_valuators);
+	fakeEventValuators(&ev, args);
+	va_end(args);
+	fakeEventPost(&ev);
+}
+
+void xf86PostButtonEvent(DeviceIntPtr device, int is_absolute, int button,
+	int is_down, int first_valuator, int num_valuators, ...)
+{
+	FakeEvent ev = { FAKE_BUTTON, device, is_absolute ? 1 : 0, button,
+		is_down, first_valuator, num_valuators };
+	va_list args;
+
+	va_start(args, num_valuators);
+	fakeEventValuators(&ev, args);
+	va_end(args);
+	fakeEventPost(&ev);
+}
+
+void xf86PostKeyboardEvent(DeviceIntPtr device, unsigned int key_code,
+	int is_down)
+{
+	FakeEvent ev = { FAKE_KEY, device, 0, key_code, is_down, 0, 0 };
+
+	fakeEventPost(&ev);
+}
+
+/*****************************************************************************
+ * Screens
+ ****************************************************************************/
+
+void fakeScreenInit(int width, int height)
+{
+	ScreenPtr screen = screenInfo.screens[0];
+
+	if (!screen)
+		screen = screenInfo.screens[0] = xcalloc(1, sizeof(ScreenRec));
+	screen->myNum = 0;
+	screen->width = width;
+	screen->height = height;
+	screenInfo.numScreens = 1;
+	dixScreenOrigins[0].x = dixScreenOrigins[0].y = 0;
+}
+
+ScreenPtr miPointerGetScreen(DeviceIntPtr pDev)
+{
+	return screenInfo.screens[0];
+}
+
+void xf86XInputSetScreen(InputInfoPtr pInfo, int screen_number, int x, int y)
+{
+}
+
+/*****************************************************************************
+ * Serial devices
+ ****************************************************************************/
+
+int xf86OpenSerial(pointer options)
+{
+	char* path = xf86FindOptionValue(options, "Device");
+
+	if (!path)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+	if (fakeSerial && fakeSerial->open)
+		return fakeSerial->open(path);
+	return open(path, O_RDWR | O_NONBLOCK);
+}
+
+int xf86SetSerialSpeed(int fd, int speed)
+{
+	return 0;
+}
+
+int xf86ReadSerial(int fd, void* buf, int count)
+{
+	if (fakeSerial && fakeSerial->read)
+		return fakeSerial->read(fd, buf, count);
+	return read(fd, buf, count);
+}
+
+int xf86WriteSerial(int fd, const void* buf, int count)
+{
+	if (fakeSerial && fakeSerial->write)
+		return fakeSerial->write(fd, buf, count);
+	return write(fd, buf, count);
+}
+
+int xf86CloseSerial(int fd)
+{
+	return close(fd);
+}
+
+int xf86WaitForInput(int fd, int timeout)
+{
+	struct pollfd pfd;
+
+	if (fakeSerial && fakeSerial->wait)
+		return fakeSerial->wait(fd, timeout);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	return poll(&pfd, fd >= 0, timeout / 1000);
+}
+
+int xf86BlockSIGIO(void)
+{
+	return 0;
+}
+
+void xf86UnblockSIGIO(int wasset)
+{
+}
+
+/*****************************************************************************
+ * Main loop: input handlers, work procedures and timers
+ ****************************************************************************/
+
+pointer xf86AddInputHandler(int fd, InputHandlerProc proc, pointer data)
+{
+	FakeHandler* handler = xcalloc(1, sizeof(FakeHandler));
+
+	if (!handler)
+		return NULL;
+	handler->fd = fd;
+	handler->proc = proc;
+	handler->data = data;
+	handler->next = fakeHandlers;
+	fakeHandlers = handler;
+	return handler;
+}
+
+int xf86RemoveInputHandler(pointer handler)
+{
+	FakeHandler** prev;
+
+	for (prev = &fakeHandlers; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == handler)
+		{
+			*prev = (*prev)->next;
+			xfree(handler);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void fakeRunInputHandlers(void)
+{
+	FakeHandler* handler;
+	FakeHandler* next;
+	struct pollfd pfd;
+
+	for (handler = fakeHandlers; handler; handler = next)
+	{
+		next = handler->next;
+		pfd.fd = handler->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 0) > 0)
+			handler->proc(handler->fd, handler->data);
+	}
+}
+
+Bool QueueWorkProc(Bool (*function)(ClientPtr client, pointer closure),
+	ClientPtr client, pointer closure)
+{
+	FakeWorkProc* work = xcalloc(1, sizeof(FakeWorkProc));
+	FakeWorkProc** last;
+
+	if (!work)
+		return FALSE;
+	work->function = function;
+	work->closure = closure;
+	for (last = &fakeWorkProcs; *last; last = &(*last)->next)
+		;
+	*last = work;
+	return TRUE;
+}
+
+void fakeRunWorkProcs(void)
+{
+	FakeWorkProc** prev = &fakeWorkProcs;
+	FakeWorkProc* work;
+
+	while ((work = *prev))
+	{
+		if (work->function(serverClient, work->closure))
+		{
+			*prev = work->next;
+			xfree(work);
+		}
+		else
+			prev = &work->next;
+	}
+}
+
+Bool RegisterBlockAndWakeupHandlers(BlockHandlerProcPtr blockHandler,
+	WakeupHandlerProcPtr wakeupHandler, pointer blockData)
+{
+	FakeBlockHandler* handler = xcalloc(1, sizeof(FakeBlockHandler));
+	FakeBlockHandler** last;
+
+	if (!handler)
+		return FALSE;
+	handler->block = blockHandler;
+	handler->wakeup = wakeupHandler;
+	handler->data = blockData;
+	for (last = &fakeBlockHandlers; *last; last = &(*last)->next)
+		;
+	*last = handler;
+	return TRUE;
+}
+
+void RemoveBlockAndWakeupHandlers(BlockHandlerProcPtr blockHandler,
+	WakeupHandlerProcPtr wakeupHandler, pointer blockData)
+{
+	FakeBlockHandler** prev;
+	FakeBlockHandler* handler;
+
+	for (prev = &fakeBlockHandlers; (handler = *prev); prev = &handler->next)
+	{
+		if (handler->block == blockHandler &&
+			handler->wakeup == wakeupHandler &&
+			handler->data == blockData)
+		{
+			*prev = handler->next;
+			xfree(handler);
+			return;
+		}
+	}
+}
+
+void NoopDDA(void)
+{
+}
+
+/* the server would block in select() right after these; there is no
+ * select() here, so the wakeup handlers aren't called */
+void fakeRunBlockHandlers(void)
+{
+	FakeBlockHandler* handler;
+	FakeBlockHandler* next;
+
+	for (handler = fakeBlockHandlers; handler; handler = next)
+	{
+		next = handler->next;
+		handler->block(handler->data, NULL, NULL);
+	}
+}
+
+/*****************************************************************************
+ * The clock. clock_gettime is taken over here so that the driver, which
+ * reads CLOCK_MONOTONIC for its own timestamps, sees the fake time too.
+ ****************************************************************************/
+
+static int (*fakeSystemClock)(clockid_t clk, struct timespec* ts);
+
+static int fakeSystemTime(clockid_t clk, struct timespec* ts)
+{
+	if (!fakeSystemClock)
+		fakeSystemClock = dlsym(RTLD_NEXT, "clock_gettime");
+	if (!fakeSystemClock)
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+	return fakeSystemClock(clk, ts);
+}
+
+int clock_gettime(clockid_t clk, struct timespec* ts)
+{
+	if (clk != CLOCK_MONOTONIC || !fakeClockFrozen)
+		return fakeSystemTime(clk, ts);
+
+	ts->tv_sec = fakeClockUsecs / 1000000;
+	ts->tv_nsec = (fakeClockUsecs % 1000000) * 1000;
+	return 0;
+}
+
+void fakeClockSet(int64_t usecs)
+{
+	fakeClockUsecs = usecs;
+	fakeClockFrozen = TRUE;
+}
+
+void fakeClockRelease(void)
+{
+	fakeClockFrozen = FALSE;
+}
+
+int64_t fakeRealTime(void)
+{
+	struct timespec ts;
+
+	fakeSystemTime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+CARD32 GetTimeInMillis(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void TimerCancel(OsTimerPtr timer)
+{
+	OsTimerPtr* prev;
+
+	for (prev = &fakeTimers; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == timer)
+		{
+			*prev = timer->next;
+			timer->next = NULL;
+			return;
+		}
+	}
+}
+
+/* timers are kept sorted by expiry */
+OsTimerPtr TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
+	OsTimerCallback func, pointer arg)
+{
+	OsTimerPtr* prev;
+	CARD32 now = GetTimeInMillis();
+
+	if (!timer)
+	{
+		timer = xcalloc(1, sizeof(struct _OsTimerRec));
+		if (!timer)
+			return NULL;
+	}
+	else
+		TimerCancel(timer);
+
+	timer->callback = func;
+	timer->arg = arg;
+	if (!millis)
+		return timer;
+
+	timer->expires = (flags & TimerAbsTime) ? millis : now + millis;
+	for (prev = &fakeTimers; *prev; prev = &(*prev)->next)
+		if ((int)((*prev)->expires - timer->expires) > 0)
+			break;
+	timer->next = *prev;
+	*prev = timer;
+	return timer;
+}
+
+void TimerFree(OsTimerPtr timer)
+{
+	if (!timer)
+		return;
+	TimerCancel(timer);
+	xfree(timer);
+}
+
+void fakeRunTimers(void)
+{
+	OsTimerPtr timer;
+	CARD32 now, next;
+
+	while ((timer = fakeTimers))
+	{
+		now = GetTimeInMillis();
+		if ((int)(timer->expires - now) > 0)
+			break;
+
+		TimerCancel(timer);
+		next = timer->callback(timer, now, timer->arg);
+		if (next)
+			TimerSet(timer, 0, next, timer->callback, timer->arg);
+	}
+}
+/* vim: set noexpandtab shiftwidth=8: */
@@ -0,0 +1,103 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __FAKE_XORG_H
+#define __FAKE_XORG_H
+
+/*****************************************************************************
+ * libwcmshim: stand-ins for the parts of the X server the driver calls, so
+ * the driver can be linked into a plain program. Posted events are
+ * recorded, the serial calls go to fakeSerial if set and the clock of the
+ * driver can be set by the program.
+ ****************************************************************************/
+
+#include "xf86Wacom.h"
+#include <stdio.h>
+
+/* event types */
+#define FAKE_MOTION    0
+#define FAKE_PROXIMITY 1
+#define FAKE_BUTTON    2
+#define FAKE_KEY       3
+#define FAKE_EVENT_TYPES 4
+
+/* an event as the driver posted it */
+typedef struct
+{
+	int type;                       /* FAKE_MOTION ... */
+	DeviceIntPtr dev;
+	int mode;                       /* is_absolute, is_in for proximity */
+	int detail;                     /* button or key code */
+	int down;
+	int first;                      /* first valuator */
+	int num;                        /* valuators */
+	int valuators[MAX_VALUATORS];
+} FakeEvent;
+
+/* an event as logged: type, "device name" and then the numbers, for
+ * motion and proximity mode, first, num and the valuators, for buttons
+ * mode, button, down, first, num and the valuators, for keys key and down */
+#define FAKE_EVENT_LINE 512
+int fakeEventFormat(const FakeEvent* ev, char* buf, int size);
+
+extern FILE* fakeEventLog;              /* posted events, NULL for none */
+extern void (*fakeEventHook)(const FakeEvent* ev); /* called for each */
+extern unsigned long fakeEventCount[FAKE_EVENT_TYPES];
+extern unsigned long fakeAllocCount;    /* calls of xalloc and friends */
+extern int fakeVerbose;                 /* print X_INFO messages too */
+
+/* the tablet behind xf86OpenSerial and friends */
+typedef struct
+{
+	int (*open)(const char* path);
+	int (*read)(int fd, void* buf, int count);
+	int (*write)(int fd, const void* buf, int count);
+	int (*wait)(int fd, int usecs);  /* > 0 if there is input */
+} FakeSerial;
+
+extern FakeSerial* fakeSerial;          /* NULL for system calls */
+
+/* the clock the driver sees through clock_gettime(CLOCK_MONOTONIC) and
+ * GetTimeInMillis; once set it stands still until set again, released it
+ * is the system clock again */
+void fakeClockSet(int64_t usecs);
+void fakeClockRelease(void);
+int64_t fakeRealTime(void);             /* the system clock in ns, always */
+
+/* option lists as the driver gets them from the server */
+pointer fakeOptionAdd(pointer list, const char* name, const char* value);
+void fakeOptionFree(pointer list);
+
+/* the screen devices map to */
+void fakeScreenInit(int width, int height);
+
+/* add a device as the server does: PreInit, then DEVICE_INIT and
+ * DEVICE_ON; options are consumed. NULL if the driver refused it. */
+LocalDevicePtr fakeDeviceAdd(InputDriverPtr drv, const char* name,
+	pointer options);
+/* DEVICE_OFF, DEVICE_CLOSE and UnInit, for all devices still there */
+void fakeDeviceRemoveAll(void);
+
+/* devices enabled with xf86AddEnabledDevice, in that order */
+LocalDevicePtr fakeEnabledDevice(int n);
+
+/* what the server does from its main loop between reads */
+void fakeRunInputHandlers(void);
+void fakeRunWorkProcs(void);
+void fakeRunBlockHandlers(void);
+void fakeRunTimers(void);
+
+#endif /* __FAKE_XORG_H */
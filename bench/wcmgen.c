@@ -0,0 +1,969 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*****************************************************************************
+ * wcmgen -- write a synthetic capture, as the "RecordFile" option would
+ * have recorded it, for wcmreplay.
+ *
+ * The capture starts with the header of one of the tablets below and
+ * holds strokes made of samples at a fixed report rate. USB tablets get
+ * the evdev frames the kernel would send, with the same suppression of
+ * unchanged values; serial tablets get the ISDV4 packets isdv4Parse
+ * decodes. Every report is one recorded read. The positions can be
+ * jittered, from a seeded generator, so a capture is the same on every
+ * run with the same arguments.
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xf86Wacom.h"
+#include "wacom-record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* what a tablet has */
+#define GEN_PEN     0x0001      /* stylus and eraser */
+#define GEN_CURSOR  0x0002
+#define GEN_TOUCH   0x0004      /* one finger */
+#define GEN_TOUCH2  0x0008      /* two fingers */
+#define GEN_PAD     0x0010      /* pad buttons */
+#define GEN_TILT    0x0020
+#define GEN_STRIP   0x0040      /* touch strips or ring */
+
+typedef struct
+{
+	const char* name;       /* as given on the command line */
+	const char* model;      /* the driver's model name */
+	int device_class;       /* WACOM_RECORD_USB or _ISDV4 */
+	int id;                 /* USB product or ISDV4 tablet id */
+	int protocol;           /* USB protocol level */
+	int resol;              /* points/inch */
+	int rate;               /* reports per second */
+	int caps;               /* GEN_* */
+	int max_x, max_y, max_z, max_dist, max_tilt;
+	int max_touch_x, max_touch_y;
+	int strips;             /* touch strips, 0 to 2 */
+	int ring;               /* max of the ring, 0 for none */
+	int padkeys;            /* pad buttons */
+	int pen_id;             /* ABS_MISC of the pen, protocol 5 */
+} GenTablet;
+
+static const GenTablet tablets[] =
+{
+	{ "penpartner", "USB PenPartner", WACOM_RECORD_USB, 0x00, 4, 1000, 100,
+		GEN_PEN,
+		5040, 3780, 255, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ "graphire3", "USB Graphire3", WACOM_RECORD_USB, 0x13, 4, 2032, 100,
+		GEN_PEN | GEN_CURSOR,
+		10208, 7424, 511, 63, 0, 0, 0, 0, 0, 0, 0 },
+	{ "intuos3", "USB Intuos3", WACOM_RECORD_USB, 0xB2, 5, 5080, 200,
+		GEN_PEN | GEN_CURSOR | GEN_PAD | GEN_TILT | GEN_STRIP,
+		60960, 45720, 1023, 63, 127, 0, 0, 2, 0, 8, 0x823 },
+	{ "intuos4", "USB Intuos4", WACOM_RECORD_USB, 0xB9, 5, 5080, 200,
+		GEN_PEN | GEN_CURSOR | GEN_PAD | GEN_TILT | GEN_STRIP,
+		44704, 27940, 2047, 63, 127, 0, 0, 0, 71, 9, 0x822 },
+	{ "cintiqv5", "USB CintiqV5", WACOM_RECORD_USB, 0xC5, 5, 5080, 200,
+		GEN_PEN | GEN_PAD | GEN_TILT | GEN_STRIP,
+		86680, 54180, 1023, 63, 127, 0, 0, 2, 0, 10, 0x823 },
+	{ "graphire4", "USB Graphire4", WACOM_RECORD_USB, 0x15, 4, 2032, 100,
+		GEN_PEN | GEN_CURSOR | GEN_PAD,
+		10208, 7424, 511, 63, 0, 0, 0, 0, 0, 2, 0 },
+	{ "bamboo", "USB Bamboo", WACOM_RECORD_USB, 0x65, 4, 2540, 100,
+		GEN_PEN | GEN_PAD,
+		14760, 9225, 511, 63, 0, 0, 0, 0, 0, 4, 0 },
+	{ "bamboo1", "USB Bamboo1", WACOM_RECORD_USB, 0x69, 4, 1012, 100,
+		GEN_PEN,
+		5104, 3712, 511, 63, 0, 0, 0, 0, 0, 0, 0 },
+	{ "bamboofun", "USB BambooFun", WACOM_RECORD_USB, 0x17, 4, 2540, 100,
+		GEN_PEN | GEN_CURSOR | GEN_PAD,
+		14760, 9225, 511, 63, 0, 0, 0, 0, 0, 4, 0 },
+	{ "cintiq", "USB PL/Cintiq", WACOM_RECORD_USB, 0xC4, 4, 508, 100,
+		GEN_PEN,
+		6282, 4762, 511, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ "cintiqpartner", "USB CintiqPartner", WACOM_RECORD_USB, 0x03, 4, 508,
+		100, GEN_PEN,
+		20480, 15360, 511, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ "intuos", "USB Intuos1", WACOM_RECORD_USB, 0x21, 5, 2540, 200,
+		GEN_PEN | GEN_CURSOR | GEN_TILT,
+		20320, 16240, 1023, 63, 127, 0, 0, 0, 0, 0, 0x022 },
+	{ "intuos2", "USB Intuos2", WACOM_RECORD_USB, 0x42, 5, 2540, 200,
+		GEN_PEN | GEN_CURSOR | GEN_TILT,
+		20320, 16240, 1023, 63, 127, 0, 0, 0, 0, 0, 0x022 },
+	{ "volito", "USB Volito", WACOM_RECORD_USB, 0x60, 4, 1016, 100,
+		GEN_PEN,
+		5104, 3712, 511, 63, 0, 0, 0, 0, 0, 0, 0 },
+	{ "volito2", "USB Volito2", WACOM_RECORD_USB, 0x62, 4, 1016, 100,
+		GEN_PEN,
+		5104, 3712, 511, 63, 0, 0, 0, 0, 0, 0, 0 },
+	{ "tabletpc", "USB TabletPC", WACOM_RECORD_USB, 0xE3, 4, 2540, 133,
+		GEN_PEN | GEN_TOUCH | GEN_TOUCH2,
+		26202, 16325, 255, 0, 0, 26202, 16325, 0, 0, 0, 0 },
+	{ "isdv4", "General ISDV4", WACOM_RECORD_ISDV4, 0x90, 4, 2540, 133,
+		GEN_PEN,
+		26202, 16325, 255, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ "isdv4-touch", "General ISDV4", WACOM_RECORD_ISDV4, 0x93, 4, 2540, 133,
+		GEN_PEN | GEN_TOUCH,
+		26202, 16325, 255, 0, 0, 4095, 4095, 0, 0, 0, 0 },
+	{ "isdv4-capacitive", "General ISDV4", WACOM_RECORD_ISDV4, 0x9A, 4, 2540,
+		133, GEN_PEN | GEN_TOUCH,
+		26202, 16325, 255, 0, 0, 4095, 4095, 0, 0, 0, 0 },
+	{ "isdv4-2fg", "General ISDV4", WACOM_RECORD_ISDV4, 0xE3, 4, 2540, 133,
+		GEN_PEN | GEN_TOUCH | GEN_TOUCH2,
+		26202, 16325, 255, 0, 0, 4095, 4095, 0, 0, 0, 0 },
+};
+
+/* a sample of each kind of tool, positions in tablet units */
+typedef struct
+{
+	int prox;
+	int x, y, pressure, distance;
+	int tiltx, tilty;       /* around 0 */
+	int buttons;            /* 1 tip, 2 side switch */
+} GenPen;
+
+typedef struct
+{
+	int fingers;            /* 0 to 2 down */
+	int x[2], y[2];
+	int capacity;
+} GenTouch;
+
+typedef struct
+{
+	unsigned int keys;      /* bit per pad button */
+	int strip[2];           /* bit position + 1, 0 if not touched */
+	int ring;               /* 0 if not touched */
+} GenPad;
+
+static struct
+{
+	const GenTablet* tablet;
+	FILE* file;
+	int64_t now;            /* time of the next report */
+	int interval;           /* between reports, in usecs */
+	int noise;              /* max jitter of positions */
+	unsigned int seed;
+
+	/* what the kernel last sent, it doesn't repeat values */
+	int abs[ABS_MAX + 1];
+	unsigned char key[KEY_MAX + 1];
+
+	/* the current read */
+	unsigned char data[4096];
+	int len;
+
+	GenPen pen;
+	GenTouch touch;
+	GenPad pad;
+	unsigned long reports;
+} gen;
+
+/*****************************************************************************
+ * Capture output
+ ****************************************************************************/
+
+static void genChunk(int type, const void* data, int len)
+{
+	WacomRecordChunk chunk;
+
+	chunk.time_us = gen.now;
+	chunk.type = type;
+	chunk.len = len;
+	if (fwrite(&chunk, sizeof(chunk), 1, gen.file) != 1 ||
+			fwrite(data, 1, len, gen.file) != len)
+	{
+		perror("wcmgen");
+		exit(1);
+	}
+}
+
+static void genSetBit(unsigned char* bits, int bit)
+{
+	bits[bit / 8] |= 1 << (bit % 8);
+}
+
+static void genAxis(WacomRecordHeader* hdr, int axis, int min, int max)
+{
+	genSetBit(hdr->abs_bits, axis);
+	hdr->abs_min[axis] = min;
+	hdr->abs_max[axis] = max;
+}
+
+/*****************************************************************************
+ * genHeader --
+ *   Write the header the driver would record when opening the tablet.
+ ****************************************************************************/
+
+static void genHeader(void)
+{
+	const GenTablet* t = gen.tablet;
+	WacomRecordHeader hdr;
+	int i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	strncpy(hdr.magic, WACOM_RECORD_MAGIC, sizeof(hdr.magic));
+	hdr.version = WACOM_RECORD_VERSION;
+	hdr.size = sizeof(hdr);
+
+	hdr.device_class = t->device_class;
+	hdr.tablet_id = t->id;
+	hdr.protocol_level = t->protocol;
+	strncpy(hdr.model, t->model, sizeof(hdr.model) - 1);
+
+	hdr.max_x = t->max_x;
+	hdr.max_y = t->max_y;
+	hdr.max_z = t->max_z;
+	hdr.max_dist = t->max_dist;
+	hdr.max_tilt_x = hdr.max_tilt_y = t->max_tilt ? t->max_tilt + 1 : 0;
+	hdr.max_touch_x = t->max_touch_x;
+	hdr.max_touch_y = t->max_touch_y;
+	hdr.max_strip_x = t->strips > 0 ? 4096 : 0;
+	hdr.max_strip_y = t->strips > 1 ? 4096 : 0;
+	hdr.resol_x = hdr.resol_y = t->resol;
+	if (t->caps & GEN_TOUCH)
+		hdr.touch_resol_x = hdr.touch_resol_y = 10;
+
+	if (t->device_class == WACOM_RECORD_ISDV4)
+	{
+		switch (t->id)
+		{
+			case 0x93: hdr.pkt_length = WACOM_PKGLEN_TOUCH93; break;
+			case 0x9A: hdr.pkt_length = WACOM_PKGLEN_TOUCH9A; break;
+			case 0xE3: hdr.pkt_length = WACOM_PKGLEN_TOUCH2FG; break;
+			default: hdr.pkt_length = WACOM_PKGLEN_TPCPEN; break;
+		}
+		genChunk(WACOM_RECORD_OPEN, &hdr, sizeof(hdr));
+		return;
+	}
+
+	hdr.pkt_length = sizeof(struct input_event);
+	hdr.flags = USE_SYN_REPORTS_FLAG | MONOTONIC_TIME_FLAG;
+	if (t->protocol == 5)
+		hdr.flags |= TILT_ENABLED_FLAG;
+	hdr.vendor = WACOM_VENDOR_ID;
+	hdr.product = t->id;
+
+	genAxis(&hdr, ABS_X, 0, t->max_x);
+	genAxis(&hdr, ABS_Y, 0, t->max_y);
+	genAxis(&hdr, ABS_PRESSURE, 0, t->max_z);
+	if (t->max_dist)
+		genAxis(&hdr, ABS_DISTANCE, 0, t->max_dist);
+	if (t->max_tilt)
+	{
+		genAxis(&hdr, ABS_TILT_X, 0, t->max_tilt);
+		genAxis(&hdr, ABS_TILT_Y, 0, t->max_tilt);
+	}
+	if (t->protocol == 5)
+	{
+		genAxis(&hdr, ABS_MISC, 0, 0);
+		genAxis(&hdr, ABS_WHEEL, 0, t->ring ? t->ring : 1023);
+	}
+	if (t->caps & GEN_CURSOR && t->protocol == 5)
+	{
+		genAxis(&hdr, ABS_RZ, -900, 899);
+		genAxis(&hdr, ABS_THROTTLE, -1023, 1023);
+	}
+	/* strips, or the size of the touch screen in tenths of points */
+	if (t->strips > 0)
+		genAxis(&hdr, ABS_RX, 0, 4096);
+	if (t->strips > 1)
+		genAxis(&hdr, ABS_RY, 0, 4096);
+	if (t->caps & GEN_TOUCH)
+	{
+		genAxis(&hdr, ABS_RX, 0, t->max_touch_x * 10);
+		genAxis(&hdr, ABS_RY, 0, t->max_touch_y * 10);
+	}
+
+	if (t->caps & GEN_PEN)
+	{
+		genSetBit(hdr.key_bits, BTN_TOOL_PEN);
+		genSetBit(hdr.key_bits, BTN_TOOL_RUBBER);
+		genSetBit(hdr.key_bits, BTN_TOUCH);
+		genSetBit(hdr.key_bits, BTN_STYLUS);
+		genSetBit(hdr.key_bits, BTN_STYLUS2);
+	}
+	if (t->caps & GEN_CURSOR)
+	{
+		genSetBit(hdr.key_bits, BTN_TOOL_MOUSE);
+		genSetBit(hdr.key_bits, BTN_LEFT);
+		genSetBit(hdr.key_bits, BTN_MIDDLE);
+		genSetBit(hdr.key_bits, BTN_RIGHT);
+		if (t->protocol == 5)
+		{
+			genSetBit(hdr.key_bits, BTN_TOOL_LENS);
+			genSetBit(hdr.key_bits, BTN_SIDE);
+			genSetBit(hdr.key_bits, BTN_EXTRA);
+		}
+	}
+	if (t->caps & GEN_TOUCH)
+		genSetBit(hdr.key_bits, BTN_TOOL_DOUBLETAP);
+	if (t->caps & GEN_TOUCH2)
+		genSetBit(hdr.key_bits, BTN_TOOL_TRIPLETAP);
+	if (t->caps & GEN_PAD)
+	{
+		genSetBit(hdr.key_bits, BTN_TOOL_FINGER);
+		for (i = 0; i < t->padkeys; i++)
+			genSetBit(hdr.key_bits, BTN_0 + i);
+	}
+
+	genChunk(WACOM_RECORD_OPEN, &hdr, sizeof(hdr));
+}
+
+/*****************************************************************************
+ * USB: evdev frames
+ ****************************************************************************/
+
+static void genEvent(int type, int code, int value)
+{
+	struct input_event ev;
+
+	if (gen.len + sizeof(ev) > sizeof(gen.data))
+	{
+		fprintf(stderr, "wcmgen: report too large\n");
+		exit(1);
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.time.tv_sec = gen.now / 1000000;
+	ev.time.tv_usec = gen.now % 1000000;
+	ev.type = type;
+	ev.code = code;
+	ev.value = value;
+	memcpy(gen.data + gen.len, &ev, sizeof(ev));
+	gen.len += sizeof(ev);
+}
+
+static void genAbs(int code, int value)
+{
+	if (gen.abs[code] == value)
+		return;
+	gen.abs[code] = value;
+	genEvent(EV_ABS, code, value);
+}
+
+static void genKey(int code, int value)
+{
+	if (gen.key[code] == value)
+		return;
+	gen.key[code] = value;
+	genEvent(EV_KEY, code, value);
+}
+
+static void genFrame(int serial)
+{
+	genEvent(EV_MSC, MSC_SERIAL, serial);
+	genEvent(EV_SYN, SYN_REPORT, 0);
+}
+
+static void usbPen(const GenPen* pen)
+{
+	const GenTablet* t = gen.tablet;
+	int v5 = (t->protocol == 5);
+
+	/* the kernel zeroes what the tool had when it leaves */
+	genKey(BTN_TOOL_PEN, pen->prox);
+	if (v5)
+		genAbs(ABS_MISC, pen->prox ? t->pen_id : 0);
+	genAbs(ABS_X, pen->prox ? pen->x : 0);
+	genAbs(ABS_Y, pen->prox ? pen->y : 0);
+	genAbs(ABS_PRESSURE, pen->prox ? pen->pressure : 0);
+	if (t->max_dist)
+		genAbs(ABS_DISTANCE, pen->prox ? pen->distance : 0);
+	if (t->max_tilt)
+	{
+		genAbs(ABS_TILT_X, pen->prox ?
+			pen->tiltx + (t->max_tilt + 1) / 2 : 0);
+		genAbs(ABS_TILT_Y, pen->prox ?
+			pen->tilty + (t->max_tilt + 1) / 2 : 0);
+	}
+	genKey(BTN_TOUCH, pen->prox && (pen->buttons & 1));
+	genKey(BTN_STYLUS, pen->prox && (pen->buttons & 2));
+	genFrame(v5 ? 0x0abc1234 : 1);
+}
+
+static void usbFinger(int tool, int down, int x, int y, int capacity,
+	int serial)
+{
+	genKey(tool, down);
+	genAbs(ABS_X, down ? x : 0);
+	genAbs(ABS_Y, down ? y : 0);
+	if (capacity)
+		genAbs(ABS_PRESSURE, down ? capacity : 0);
+	genFrame(serial);
+}
+
+static void usbTouch(const GenTouch* touch, const GenTouch* last)
+{
+	/* one frame per finger, the second finger on channel 1 */
+	if (touch->fingers > 0 || last->fingers > 0)
+		usbFinger(BTN_TOOL_DOUBLETAP, touch->fingers > 0,
+			touch->x[0], touch->y[0], touch->capacity, 1);
+	if (touch->fingers > 1 || last->fingers > 1)
+		usbFinger(BTN_TOOL_TRIPLETAP, touch->fingers > 1,
+			touch->x[1], touch->y[1], 0, 0xf0);
+}
+
+static void usbPad(const GenPad* pad)
+{
+	const GenTablet* t = gen.tablet;
+	int i, active = pad->keys || pad->strip[0] || pad->strip[1] ||
+		pad->ring;
+
+	genKey(BTN_TOOL_FINGER, active);
+	for (i = 0; i < t->padkeys; i++)
+		genKey(BTN_0 + i, (pad->keys >> i) & 1);
+	if (t->strips > 0)
+		genAbs(ABS_RX, pad->strip[0] ? 1 << (pad->strip[0] - 1) : 0);
+	if (t->strips > 1)
+		genAbs(ABS_RY, pad->strip[1] ? 1 << (pad->strip[1] - 1) : 0);
+	if (t->ring)
+		genAbs(ABS_WHEEL, pad->ring);
+
+	if (t->protocol == 5)
+	{
+		genAbs(ABS_MISC, active ? PAD_DEVICE_ID : 0);
+		genFrame(-1);
+	}
+	else
+		genFrame(0xf0);
+}
+
+/*****************************************************************************
+ * ISDV4: serial packets
+ ****************************************************************************/
+
+static void isdv4Pen(const GenPen* pen)
+{
+	unsigned char* data = gen.data + gen.len;
+	int x = pen->x, y = pen->y, z = pen->pressure;
+
+	memset(data, 0, WACOM_PKGLEN_TPCPEN);
+	data[0] = HEADER_BIT;
+	if (pen->prox)
+	{
+		data[0] |= 0x20 | (pen->buttons & 0x03);
+		data[1] = (x >> 9) & 0x7f;
+		data[2] = (x >> 2) & 0x7f;
+		data[3] = (y >> 9) & 0x7f;
+		data[4] = (y >> 2) & 0x7f;
+		data[5] = z & 0x7f;
+		data[6] = ((z >> 7) & 0x07) | ((y & 0x03) << 3) |
+			((x & 0x03) << 5);
+	}
+	gen.len += WACOM_PKGLEN_TPCPEN;
+}
+
+static void isdv4Touch(const GenTouch* touch)
+{
+	unsigned char* data = gen.data + gen.len;
+	int i, len;
+
+	switch (gen.tablet->id)
+	{
+		case 0x9A: len = WACOM_PKGLEN_TOUCH9A; break;
+		case 0xE3: len = WACOM_PKGLEN_TOUCH2FG; break;
+		default: len = WACOM_PKGLEN_TOUCH93; break;
+	}
+
+	memset(data, 0, len);
+	data[0] = HEADER_BIT | 0x10;
+	for (i = 0; i < touch->fingers; i++)
+	{
+		data[0] |= 1 << i;
+		data[1 + i * 6] = (touch->x[i] >> 7) & 0x7f;
+		data[2 + i * 6] = touch->x[i] & 0x7f;
+		data[3 + i * 6] = (touch->y[i] >> 7) & 0x7f;
+		data[4 + i * 6] = touch->y[i] & 0x7f;
+	}
+	if (len == WACOM_PKGLEN_TOUCH9A && touch->fingers)
+	{
+		data[5] = (touch->capacity >> 7) & 0x7f;
+		data[6] = touch->capacity & 0x7f;
+	}
+	gen.len += len;
+}
+
+/*****************************************************************************
+ * Reports
+ ****************************************************************************/
+
+/* one report per interval, recorded as one read */
+static void genReport(void)
+{
+	if (gen.len)
+	{
+		genChunk(WACOM_RECORD_DATA, gen.data, gen.len);
+		gen.reports++;
+	}
+	gen.len = 0;
+	gen.now += gen.interval;
+}
+
+static void genIdle(int ms)
+{
+	gen.now += (int64_t)ms * 1000;
+}
+
+static int genRandom(int range)
+{
+	/* xorshift, the same numbers for the same seed everywhere */
+	gen.seed ^= gen.seed << 13;
+	gen.seed ^= gen.seed >> 17;
+	gen.seed ^= gen.seed << 5;
+	return range ? (int)(gen.seed % (2 * range + 1)) - range : 0;
+}
+
+static int genClip(int v, int max)
+{
+	return v < 0 ? 0 : v > max ? max : v;
+}
+
+/* a position from 0..1 on an axis, jittered */
+static int genPos(double v, int max)
+{
+	return genClip((int)(v * max + 0.5) + genRandom(gen.noise), max);
+}
+
+static void genPen(int prox, double x, double y, double pressure,
+	double distance, int tiltx, int tilty)
+{
+	const GenTablet* t = gen.tablet;
+	GenPen* pen = &gen.pen;
+
+	pen->prox = prox;
+	pen->x = genPos(x, t->max_x);
+	pen->y = genPos(y, t->max_y);
+	pen->pressure = genClip((int)(pressure * t->max_z), t->max_z);
+	pen->distance = genClip((int)(distance * t->max_dist), t->max_dist);
+	pen->tiltx = tiltx;
+	pen->tilty = tilty;
+	pen->buttons = pen->pressure ? 1 : 0;
+
+	if (t->device_class == WACOM_RECORD_USB)
+		usbPen(pen);
+	else
+		isdv4Pen(pen);
+	genReport();
+}
+
+static void genTouch(int fingers, double x0, double y0, double x1, double y1)
+{
+	const GenTablet* t = gen.tablet;
+	GenTouch last = gen.touch;
+	GenTouch* touch = &gen.touch;
+
+	touch->fingers = fingers;
+	touch->x[0] = genPos(x0, t->max_touch_x);
+	touch->y[0] = genPos(y0, t->max_touch_y);
+	touch->x[1] = genPos(x1, t->max_touch_x);
+	touch->y[1] = genPos(y1, t->max_touch_y);
+	touch->capacity = (t->id == 0x9A) ? 200 + genRandom(20) : 0;
+
+	if (t->device_class == WACOM_RECORD_USB)
+		usbTouch(touch, &last);
+	else
+		isdv4Touch(touch);
+	genReport();
+}
+
+/* pads only report changes */
+static void genPad(unsigned int keys, int strip0, int strip1, int ring)
+{
+	GenPad* pad = &gen.pad;
+
+	if (pad->keys != keys || pad->strip[0] != strip0 ||
+			pad->strip[1] != strip1 || pad->ring != ring)
+	{
+		pad->keys = keys;
+		pad->strip[0] = strip0;
+		pad->strip[1] = strip1;
+		pad->ring = ring;
+		usbPad(pad);
+	}
+	genReport();
+}
+
+/*****************************************************************************
+ * Strokes, n samples each
+ ****************************************************************************/
+
+typedef void (*GenPath)(double t, double* x, double* y, double* pressure);
+
+/*****************************************************************************
+ * genStroke --
+ *   Come into prox above the start of a path, follow it touching, lift
+ *   and leave.
+ ****************************************************************************/
+
+static void genStroke(GenPath path, int n)
+{
+	double x, y, p, env;
+	int i;
+
+	path(0, &x, &y, &p);
+	for (i = 0; i < 4; i++)
+		genPen(1, x, y, 0, 0.8 - i * 0.2, 0, 0);
+
+	for (i = 0; i < n; i++)
+	{
+		double t = n > 1 ? (double)i / (n - 1) : 0;
+
+		/* pressure builds up and fades at the ends */
+		env = t < 0.1 ? t / 0.1 : t > 0.9 ? (1 - t) / 0.1 : 1;
+		if (env < 0.05)
+			env = 0.05;
+		path(t, &x, &y, &p);
+		genPen(1, x, y, p * env, 0, 0, 0);
+	}
+
+	for (i = 1; i <= 4; i++)
+		genPen(1, x, y, 0, i * 0.2, 0, 0);
+	genPen(0, 0, 0, 0, 0, 0, 0);
+	genIdle(100);
+}
+
+static void pathLine(double t, double* x, double* y, double* pressure)
+{
+	*x = 0.1 + 0.8 * t;
+	*y = 0.2 + 0.6 * t;
+	*pressure = 0.6;
+}
+
+static void pathCircle(double t, double* x, double* y, double* pressure)
+{
+	const GenTablet* tab = gen.tablet;
+	double r = 0.3;
+
+	/* round on the tablet, not in tablet units */
+	*x = 0.5 + r * cos(2 * M_PI * t) * tab->max_y / tab->max_x;
+	*y = 0.5 + r * sin(2 * M_PI * t);
+	*pressure = 0.5 + 0.1 * sin(6 * M_PI * t);
+}
+
+static int word;    /* of the handwriting */
+
+static void pathWrite(double t, double* x, double* y, double* pressure)
+{
+	/* cursive loops along a line, pressing harder on the down strokes */
+	double phase = 2 * M_PI * 6 * t;
+
+	*x = 0.1 + 0.2 * word + 0.16 * t + 0.015 * sin(phase);
+	*y = 0.5 + 0.04 * cos(phase) + 0.01 * sin(phase / 3);
+	*pressure = 0.45 + 0.25 * sin(phase + M_PI / 4);
+}
+
+static void strokeLine(int n)
+{
+	genStroke(pathLine, n);
+}
+
+static void strokeCircle(int n)
+{
+	genStroke(pathCircle, n);
+}
+
+static void strokeWrite(int n)
+{
+	for (word = 0; word < 4; word++)
+		genStroke(pathWrite, n / 4);
+}
+
+static void strokeHover(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		double t = (double)i / n;
+
+		genPen(1, 0.2 + 0.6 * t, 0.7 - 0.4 * t + 0.05 * sin(8 * M_PI * t),
+			0, 0.5 + 0.4 * sin(2 * M_PI * t), 0, 0);
+	}
+	genPen(0, 0, 0, 0, 0, 0, 0);
+	genIdle(100);
+}
+
+static void strokeTilt(int n)
+{
+	int i, range = gen.tablet->max_tilt / 2;
+
+	genPen(1, 0.5, 0.5, 0, 0.2, 0, 0);
+	for (i = 0; i < n; i++)
+	{
+		double t = 2 * M_PI * i / n;
+
+		/* the pen swept around on its tip, leaning further out */
+		genPen(1, 0.5, 0.5, 0.4, 0,
+			(int)(range * (i + 1.0) / n * cos(t)),
+			(int)(range * (i + 1.0) / n * sin(t)));
+	}
+	genPen(1, 0.5, 0.5, 0, 0.2, 0, 0);
+	genPen(0, 0, 0, 0, 0, 0, 0);
+	genIdle(100);
+}
+
+static void strokeDrag(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		double t = (double)i / n;
+
+		genTouch(1, 0.2 + 0.6 * t, 0.5 + 0.2 * sin(2 * M_PI * t), 0, 0);
+	}
+	genTouch(0, 0, 0, 0, 0);
+	genIdle(100);
+}
+
+static void strokeScroll(int n)
+{
+	int i;
+
+	/* fingers rarely land in the same report */
+	genTouch(1, 0.45, 0.3, 0, 0);
+	for (i = 0; i < n; i++)
+	{
+		double y = 0.3 + 0.4 * i / n;
+
+		genTouch(2, 0.45, y, 0.55, y);
+	}
+	genTouch(1, 0.45, 0.7, 0, 0);
+	genTouch(0, 0, 0, 0, 0);
+	genIdle(100);
+}
+
+static void strokeZoom(int n)
+{
+	int i;
+
+	genTouch(1, 0.45, 0.5, 0, 0);
+	for (i = 0; i < n; i++)
+	{
+		double d = 0.05 + 0.25 * i / n;
+
+		genTouch(2, 0.5 - d, 0.5 - d / 2, 0.5 + d, 0.5 + d / 2);
+	}
+	genTouch(1, 0.2, 0.35, 0, 0);
+	genTouch(0, 0, 0, 0, 0);
+	genIdle(100);
+}
+
+static void strokePad(int n)
+{
+	int i, keys = gen.tablet->padkeys;
+
+	/* each button in turn, down one report and up the next */
+	for (i = 0; i < n; i++)
+		genPad((i & 1) ? 0 : 1 << ((i / 2) % keys), 0, 0, 0);
+	genPad(0, 0, 0, 0);
+	genIdle(100);
+}
+
+static void strokeStrip(int n)
+{
+	const GenTablet* t = gen.tablet;
+	int i, pos;
+
+	/* swipes up and down the strips, or around the ring */
+	for (i = 0; i < n; i++)
+	{
+		pos = i % 16;
+		if (pos >= 13)
+			genPad(0, 0, 0, 0);
+		else if (t->ring)
+			genPad(0, 0, 0, 1 + (i * 3) % t->ring);
+		else if (t->strips > 1 && (i / 16) & 1)
+			genPad(0, 0, 13 - pos, 0);
+		else
+			genPad(0, 1 + pos, 0, 0);
+	}
+	genPad(0, 0, 0, 0);
+	genIdle(100);
+}
+
+static const struct
+{
+	const char* name;
+	void (*gen)(int n);
+	int caps;               /* what the tablet needs for it */
+} strokes[] =
+{
+	{ "line",   strokeLine,   GEN_PEN },
+	{ "circle", strokeCircle, GEN_PEN },
+	{ "write",  strokeWrite,  GEN_PEN },
+	{ "hover",  strokeHover,  GEN_PEN },
+	{ "tilt",   strokeTilt,   GEN_PEN | GEN_TILT },
+	{ "drag",   strokeDrag,   GEN_TOUCH },
+	{ "scroll", strokeScroll, GEN_TOUCH2 },
+	{ "zoom",   strokeZoom,   GEN_TOUCH2 },
+	{ "pad",    strokePad,    GEN_PAD },
+	{ "strip",  strokeStrip,  GEN_PAD | GEN_STRIP },
+};
+
+/*****************************************************************************
+ * Main
+ ****************************************************************************/
+
+static void usage(void)
+{
+	int i;
+
+	fprintf(stderr,
+		"usage: wcmgen [options] tablet capture\n"
+		"  -c count        repeat the strokes count times, default 1\n"
+		"  -d ms           duration of each stroke, default 1000\n"
+		"  -n units        jitter positions by up to units, default 0\n"
+		"  -r rate         reports per second, default the tablet's\n"
+		"  -s stroke,...   strokes to make, default all the tablet has\n"
+		"  -S seed         seed of the jitter, default 1\n"
+		"tablets:");
+	for (i = 0; i < ARRAY_SIZE(tablets); i++)
+		fprintf(stderr, " %s", tablets[i].name);
+	fprintf(stderr, "\nstrokes:");
+	for (i = 0; i < ARRAY_SIZE(strokes); i++)
+		fprintf(stderr, " %s", strokes[i].name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* list = NULL;
+	const char* path;
+	char* names, *name;
+	int count = 1, duration = 1000, rate = 0;
+	int i, c, n, made = 0;
+	int selected[ARRAY_SIZE(strokes)];
+
+	gen.seed = 1;
+	while ((c = getopt(argc, argv, "c:d:n:r:s:S:")) != -1)
+	{
+		switch (c)
+		{
+			case 'c':
+				count = atoi(optarg);
+				break;
+			case 'd':
+				duration = atoi(optarg);
+				break;
+			case 'n':
+				gen.noise = atoi(optarg);
+				break;
+			case 'r':
+				rate = atoi(optarg);
+				break;
+			case 's':
+				list = optarg;
+				break;
+			case 'S':
+				gen.seed = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind != argc - 2 || count <= 0 || duration <= 0 ||
+			rate < 0 || gen.noise < 0)
+	{
+		usage();
+		return 1;
+	}
+	/* xorshift never leaves 0 */
+	if (!gen.seed)
+		gen.seed = 1;
+
+	for (i = 0; i < ARRAY_SIZE(tablets); i++)
+		if (!strcmp(tablets[i].name, argv[optind]))
+			gen.tablet = &tablets[i];
+	if (!gen.tablet)
+	{
+		fprintf(stderr, "wcmgen: unknown tablet %s\n", argv[optind]);
+		usage();
+		return 1;
+	}
+
+	/* the strokes asked for, or all this tablet can do */
+	for (i = 0; i < ARRAY_SIZE(strokes); i++)
+		selected[i] = !list && (strokes[i].caps & gen.tablet->caps) ==
+			strokes[i].caps;
+	if (list)
+	{
+		names = strdup(list);
+		for (name = strtok(names, ","); name; name = strtok(NULL, ","))
+		{
+			for (i = 0; i < ARRAY_SIZE(strokes); i++)
+				if (!strcmp(strokes[i].name, name))
+					break;
+			if (i == ARRAY_SIZE(strokes))
+			{
+				fprintf(stderr, "wcmgen: unknown stroke %s\n", name);
+				usage();
+				return 1;
+			}
+			if ((strokes[i].caps & gen.tablet->caps) != strokes[i].caps)
+				fprintf(stderr, "wcmgen: %s has nothing for %s, "
+					"skipped\n", gen.tablet->name, name);
+			else
+				selected[i] = 1;
+		}
+		free(names);
+	}
+
+	if (!rate)
+		rate = gen.tablet->rate;
+	gen.interval = 1000000 / rate;
+	if (!gen.interval)
+		gen.interval = 1;
+	n = (int64_t)duration * rate / 1000;
+	if (n < 2)
+		n = 2;
+
+	path = argv[optind + 1];
+	gen.file = fopen(path, "w");
+	if (!gen.file)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	/* as if the tablet was opened a second after boot */
+	gen.now = 1000000;
+	genHeader();
+	genIdle(100);
+
+	while (count--)
+		for (i = 0; i < ARRAY_SIZE(strokes); i++)
+			if (selected[i])
+			{
+				strokes[i].gen(n);
+				made++;
+			}
+
+	if (fclose(gen.file))
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	fprintf(stderr, "%s: %s, %d strokes, %lu reports at %d/sec\n",
+		path, gen.tablet->name, made, gen.reports, rate);
+	return 0;
+}
+/* vim: set noexpandtab shiftwidth=8: */
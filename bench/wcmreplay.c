@@ -0,0 +1,867 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*****************************************************************************
+ * wcmreplay -- feed a file written with the "RecordFile" option through
+ * the driver, without a tablet or an X server.
+ *
+ * The capture file itself is the device: the driver opens it as usual,
+ * its ioctls are answered from the header the recording started with and
+ * each read returns what the recorded read returned. One recorded read is
+ * handed out per wakeup of the device, as fast as the driver takes them or
+ * at the speed they were recorded. As fast as it goes, the driver's clock
+ * is set to the time each read was recorded at, so that its timeouts see
+ * the same gaps as on the tablet and a replay always gives the same events.
+ * That makes a replay a regression check: the events posted can be
+ * compared with those of an earlier run, see goldenCheck.
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fake-xorg.h"
+#include "wacom-record.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/serial.h>
+
+extern InputDriverRec WACOM;
+
+static const char* toolTypes[] =
+	{ "stylus", "eraser", "cursor", "touch", "pad" };
+
+static struct
+{
+	unsigned char* data;        /* the whole capture */
+	size_t size;
+	size_t next;                /* offset of the next chunk */
+	WacomRecordHeader hdr;      /* from the first open */
+	unsigned long keys[NBITS(KEY_MAX)]; /* its bits, aligned */
+	unsigned long abs[NBITS(ABS_MAX)];
+	dev_t dev;                  /* the capture file, to tell its fds */
+	ino_t ino;
+
+	const unsigned char* chunk; /* data of the current read */
+	int len;
+	int pos;                    /* handed out so far */
+	int64_t time_us;            /* when it was read or opened */
+
+	char answer[WACOM_PKGLEN_TPCCTL]; /* to an ISDV4 query */
+	int answerLen;
+
+	unsigned long reads;        /* chunks replayed */
+	unsigned long reopens;      /* later opens, skipped */
+	unsigned long long bytes;
+} replay;
+
+/*****************************************************************************
+ * replayLoad --
+ *   Read the capture and the header of its first open.
+ ****************************************************************************/
+
+static int replayLoad(const char* path)
+{
+	WacomRecordChunk chunk;
+	struct stat st;
+	FILE* file;
+	int len;
+
+	file = fopen(path, "r");
+	if (!file || fstat(fileno(file), &st))
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return !Success;
+	}
+
+	replay.dev = st.st_dev;
+	replay.ino = st.st_ino;
+	replay.size = st.st_size;
+	replay.data = xalloc(replay.size + 1);
+	if (!replay.data || fread(replay.data, 1, replay.size, file) !=
+			replay.size)
+	{
+		fprintf(stderr, "%s: unable to read the capture\n", path);
+		fclose(file);
+		return !Success;
+	}
+	fclose(file);
+
+	if (replay.size < sizeof(chunk))
+		goto bad;
+	memcpy(&chunk, replay.data, sizeof(chunk));
+	if (chunk.type != WACOM_RECORD_OPEN ||
+			chunk.len > replay.size - sizeof(chunk) ||
+			chunk.len < offsetof(WacomRecordHeader, device_class))
+		goto bad;
+
+	/* newer writers may add to the end of the header */
+	len = chunk.len < sizeof(replay.hdr) ? chunk.len : sizeof(replay.hdr);
+	memcpy(&replay.hdr, replay.data + sizeof(chunk), len);
+	if (strncmp(replay.hdr.magic, WACOM_RECORD_MAGIC,
+			sizeof(replay.hdr.magic)) ||
+			replay.hdr.version != WACOM_RECORD_VERSION)
+		goto bad;
+
+	memcpy(replay.keys, replay.hdr.key_bits, sizeof(replay.keys));
+	memcpy(replay.abs, replay.hdr.abs_bits, sizeof(replay.abs));
+	replay.next = sizeof(chunk) + chunk.len;
+	replay.time_us = chunk.time_us;
+	return Success;
+
+bad:
+	fprintf(stderr, "%s: not a wacom capture\n", path);
+	return !Success;
+}
+
+/*****************************************************************************
+ * replayNext --
+ *   Make the next recorded read current. Returns FALSE at the end.
+ ****************************************************************************/
+
+static Bool replayNext(void)
+{
+	WacomRecordChunk chunk;
+
+	replay.chunk = NULL;
+	replay.len = replay.pos = 0;
+
+	while (replay.size - replay.next >= sizeof(chunk))
+	{
+		memcpy(&chunk, replay.data + replay.next, sizeof(chunk));
+		if (chunk.len > replay.size - replay.next - sizeof(chunk))
+		{
+			fprintf(stderr, "capture truncated\n");
+			return FALSE;
+		}
+
+		replay.next += sizeof(chunk);
+		replay.chunk = replay.data + replay.next;
+		replay.next += chunk.len;
+
+		/* the device is set up once, from the first header */
+		if (chunk.type == WACOM_RECORD_OPEN)
+		{
+			replay.reopens++;
+			continue;
+		}
+		if (chunk.type != WACOM_RECORD_DATA || !chunk.len)
+			continue;
+
+		replay.len = chunk.len;
+		replay.time_us = chunk.time_us;
+		replay.reads++;
+		replay.bytes += chunk.len;
+		return TRUE;
+	}
+	replay.chunk = NULL;
+	return FALSE;
+}
+
+/*****************************************************************************
+ * The serial calls of the driver go to the capture
+ ****************************************************************************/
+
+static int replayOpen(const char* path)
+{
+	return open(path, O_RDONLY);
+}
+
+static int replayRead(int fd, void* buf, int count)
+{
+	int len;
+
+	if (replay.answerLen)
+	{
+		len = count < replay.answerLen ? count : replay.answerLen;
+		memcpy(buf, replay.answer, len);
+		replay.answerLen = 0;
+		return len;
+	}
+
+	len = replay.len - replay.pos;
+	if (len <= 0)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+	if (len > count)
+		len = count;
+	memcpy(buf, replay.chunk + replay.pos, len);
+	replay.pos += len;
+	return len;
+}
+
+/* answer ISDV4 queries as the tablet the recording was made with */
+static int replayWrite(int fd, const void* buf, int count)
+{
+	const WacomRecordHeader* hdr = &replay.hdr;
+	char* data = replay.answer;
+	int id = hdr->tablet_id;
+
+	if (hdr->device_class != WACOM_RECORD_ISDV4 || count < 1)
+		return count;
+
+	memset(data, 0, sizeof(replay.answer));
+	switch (*(const char*)buf)
+	{
+		case '*': /* pen ranges */
+			data[0] = 0xC0;
+			data[1] = (hdr->max_x >> 9) & 0x7f;
+			data[2] = (hdr->max_x >> 2) & 0x7f;
+			data[3] = (hdr->max_y >> 9) & 0x7f;
+			data[4] = (hdr->max_y >> 2) & 0x7f;
+			data[5] = hdr->max_z & 0x7f;
+			data[6] = ((hdr->max_z >> 7) & 0x07) |
+				((hdr->max_y & 0x03) << 3) |
+				((hdr->max_x & 0x03) << 5);
+			if (hdr->flags & TILT_ENABLED_FLAG)
+			{
+				data[7] = hdr->max_tilt_x - 1;
+				data[8] = hdr->max_tilt_y - 1;
+			}
+			break;
+		case '%': /* touch ranges, only tablets with touch answer */
+			if (id == 0x90)
+				return count;
+			data[0] = 0xC0 | ((id == 0xE2 || id == 0xE3) ? 0x03 : 0x01);
+			data[1] = hdr->touch_resol_x ? 1 : 0;
+			data[2] = (id == 0x9A) ? 0x01 : (id == 0x9F) ? 0x03 :
+				(id == 0xE2 || id == 0xE3) ? 0x05 : 0x00;
+			data[2] |= ((hdr->max_touch_x & 0x03) << 5) |
+				((hdr->max_touch_y & 0x03) << 3);
+			data[3] = (hdr->max_touch_x >> 9) & 0x7f;
+			data[4] = (hdr->max_touch_x >> 2) & 0x7f;
+			data[5] = (hdr->max_touch_y >> 9) & 0x7f;
+			data[6] = (hdr->max_touch_y >> 2) & 0x7f;
+			break;
+		default: /* start and stop */
+			return count;
+	}
+	replay.answerLen = WACOM_PKGLEN_TPCCTL;
+	return count;
+}
+
+static int replayWait(int fd, int usecs)
+{
+	return (replay.answerLen || replay.pos < replay.len) ? 1 : 0;
+}
+
+static FakeSerial replaySerial =
+{
+	replayOpen,
+	replayRead,
+	replayWrite,
+	replayWait,
+};
+
+/*****************************************************************************
+ * ioctl --
+ *   Answer the ioctls on the capture from the header, pass the others on.
+ ****************************************************************************/
+
+static void replaySetBit(unsigned char* bits, int bit)
+{
+	((unsigned long*)bits)[bit / BITS_PER_LONG] |=
+		1UL << (bit % BITS_PER_LONG);
+}
+
+static int replayBits(int type, unsigned char* bits, int size)
+{
+	int len;
+
+	memset(bits, 0, size);
+	switch (type)
+	{
+		case 0:
+			replaySetBit(bits, EV_SYN);
+			replaySetBit(bits, EV_KEY);
+			replaySetBit(bits, EV_ABS);
+			replaySetBit(bits, EV_MSC);
+			if (ISBITSET(replay.keys, BTN_TOOL_MOUSE))
+				replaySetBit(bits, EV_REL);
+			return size;
+		case EV_KEY:
+			len = sizeof(replay.keys);
+			memcpy(bits, replay.keys, len < size ? len : size);
+			return size;
+		case EV_ABS:
+			len = sizeof(replay.abs);
+			memcpy(bits, replay.abs, len < size ? len : size);
+			return size;
+		/* not recorded; as a tablet has them, they only size queues */
+		case EV_REL:
+			if (ISBITSET(replay.keys, BTN_TOOL_MOUSE))
+				replaySetBit(bits, REL_WHEEL);
+			return size;
+		case EV_MSC:
+			replaySetBit(bits, MSC_SERIAL);
+			return size;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+static int replayIoctl(unsigned long request, void* arg)
+{
+	const WacomRecordHeader* hdr = &replay.hdr;
+	struct input_absinfo* absinfo = arg;
+	struct input_id* id = arg;
+	int nr = _IOC_NR(request);
+	int size = _IOC_SIZE(request);
+
+	if (request == TIOCGSERIAL)
+	{
+		if (hdr->device_class != WACOM_RECORD_ISDV4)
+			goto notty;
+		memset(arg, 0, sizeof(struct serial_struct));
+		return 0;
+	}
+
+	if (hdr->device_class != WACOM_RECORD_USB || _IOC_TYPE(request) != 'E')
+		goto notty;
+
+	switch (request)
+	{
+		case EVIOCGVERSION:
+			*(int*)arg = EV_VERSION;
+			return 0;
+		case EVIOCGRAB:
+			return 0;
+		case EVIOCGID:
+			memset(id, 0, sizeof(*id));
+			id->bustype = BUS_USB;
+			id->vendor = hdr->vendor;
+			id->product = hdr->product;
+			return 0;
+		case EVIOCSCLOCKID:
+			if (hdr->flags & MONOTONIC_TIME_FLAG)
+				return 0;
+			errno = EINVAL;
+			return -1;
+	}
+
+	if (_IOC_DIR(request) != _IOC_READ)
+		goto notty;
+
+	if (nr == _IOC_NR(EVIOCGNAME(0)))
+		return snprintf(arg, size, "Wacom %s", hdr->model) + 1;
+	if (nr == _IOC_NR(EVIOCGKEY(0)))
+	{
+		/* the capture starts with nothing pressed */
+		memset(arg, 0, size);
+		return size;
+	}
+	if (nr >= _IOC_NR(EVIOCGBIT(0, 0)) && nr <= _IOC_NR(EVIOCGBIT(EV_MAX, 0)))
+		return replayBits(nr - _IOC_NR(EVIOCGBIT(0, 0)), arg, size);
+	if (nr >= _IOC_NR(EVIOCGABS(0)) && nr < _IOC_NR(EVIOCGABS(0)) +
+			WACOM_RECORD_ABS_AXES)
+	{
+		nr -= _IOC_NR(EVIOCGABS(0));
+		if (!ISBITSET(replay.abs, nr))
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		memset(absinfo, 0, size);
+		absinfo->minimum = hdr->abs_min[nr];
+		absinfo->maximum = hdr->abs_max[nr];
+		return 0;
+	}
+
+notty:
+	errno = ENOTTY;
+	return -1;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	struct stat st;
+	va_list args;
+	void* arg;
+
+	va_start(args, request);
+	arg = va_arg(args, void*);
+	va_end(args);
+
+	if (fd >= 0 && !fstat(fd, &st) && st.st_dev == replay.dev &&
+			st.st_ino == replay.ino)
+		return replayIoctl(request, arg);
+
+	return syscall(SYS_ioctl, fd, request, arg);
+}
+
+/*****************************************************************************
+ * Golden output
+ *
+ * The events the driver posts are compared, as they are posted, with a
+ * file written by an earlier run with -e. Everything has to match except
+ * the valuators, which may be off by the tolerance, for changes to the
+ * filters that are allowed to move the pointer a little.
+ ****************************************************************************/
+
+#define GOLDEN_REPORT 10        /* mismatches printed */
+
+static struct
+{
+	FILE* file;
+	const char* path;
+	int tolerance;          /* of the valuators */
+	unsigned long events;   /* compared so far */
+	unsigned long mismatches;
+} golden;
+
+/*****************************************************************************
+ * goldenParse --
+ *   Read an event as fakeEventFormat prints it. The device name is put in
+ *   name, ev->dev is left alone.
+ ****************************************************************************/
+
+static Bool goldenParse(const char* line, FakeEvent* ev, char* name, int size)
+{
+	static const char* names[FAKE_EVENT_TYPES] =
+		{ "motion", "proximity", "button", "key" };
+	int nums[5 + MAX_VALUATORS];
+	const char* end;
+	char* next;
+	int i, n, fixed;
+
+	for (ev->type = 0; ev->type < FAKE_EVENT_TYPES; ev->type++)
+	{
+		n = strlen(names[ev->type]);
+		if (!strncmp(line, names[ev->type], n) && line[n] == ' ')
+			break;
+	}
+	if (ev->type == FAKE_EVENT_TYPES)
+		return FALSE;
+
+	line += n + 1;
+	end = (*line == '"') ? strchr(line + 1, '"') : NULL;
+	if (!end || end - line - 1 >= size)
+		return FALSE;
+	memcpy(name, line + 1, end - line - 1);
+	name[end - line - 1] = '\0';
+
+	for (n = 0, line = end + 1; n < ARRAY_SIZE(nums); n++, line = next)
+	{
+		nums[n] = strtol(line, &next, 10);
+		if (next == line)
+			break;
+	}
+
+	memset(ev->valuators, 0, sizeof(ev->valuators));
+	ev->mode = ev->detail = ev->down = ev->first = ev->num = 0;
+	switch (ev->type)
+	{
+		case FAKE_KEY:
+			ev->detail = nums[0];
+			ev->down = nums[1];
+			return n == 2;
+		case FAKE_BUTTON:
+			ev->mode = nums[0];
+			ev->detail = nums[1];
+			ev->down = nums[2];
+			fixed = 3;
+			break;
+		default:
+			ev->mode = nums[0];
+			fixed = 1;
+			break;
+	}
+	if (n < fixed + 2)
+		return FALSE;
+	ev->first = nums[fixed];
+	ev->num = nums[fixed + 1];
+	if (ev->num < 0 || ev->num > MAX_VALUATORS || n != fixed + 2 + ev->num)
+		return FALSE;
+	for (i = 0; i < ev->num; i++)
+		ev->valuators[i] = nums[fixed + 2 + i];
+	return TRUE;
+}
+
+static void goldenMismatch(const char* expected, const FakeEvent* ev)
+{
+	char line[FAKE_EVENT_LINE];
+
+	if (++golden.mismatches > GOLDEN_REPORT)
+		return;
+
+	if (ev)
+		fakeEventFormat(ev, line, sizeof(line));
+	fprintf(stderr, "%s:%lu: expected %s\n%s:%lu: posted   %s\n",
+		golden.path, golden.events, expected ? expected : "nothing",
+		golden.path, golden.events, ev ? line : "nothing");
+}
+
+/*****************************************************************************
+ * goldenCheck --
+ *   fakeEventHook: compare a posted event with the next one of the file.
+ ****************************************************************************/
+
+static void goldenCheck(const FakeEvent* ev)
+{
+	char line[FAKE_EVENT_LINE], name[FAKE_EVENT_LINE];
+	FakeEvent expect;
+	int i, len;
+
+	golden.events++;
+	if (!fgets(line, sizeof(line), golden.file))
+	{
+		goldenMismatch(NULL, ev);
+		return;
+	}
+	len = strlen(line);
+	if (len && line[len - 1] == '\n')
+		line[len - 1] = '\0';
+
+	if (!goldenParse(line, &expect, name, sizeof(name)) ||
+			expect.type != ev->type || strcmp(name, ev->dev->name) ||
+			expect.mode != ev->mode || expect.detail != ev->detail ||
+			expect.down != ev->down || expect.first != ev->first ||
+			expect.num != ev->num)
+	{
+		goldenMismatch(line, ev);
+		return;
+	}
+
+	for (i = 0; i < ev->num; i++)
+		if (ABS(expect.valuators[i] - ev->valuators[i]) >
+				golden.tolerance)
+		{
+			goldenMismatch(line, ev);
+			return;
+		}
+}
+
+/* what the driver didn't post */
+static void goldenFinish(void)
+{
+	char line[FAKE_EVENT_LINE];
+	int len;
+
+	while (fgets(line, sizeof(line), golden.file))
+	{
+		len = strlen(line);
+		if (len && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		golden.events++;
+		goldenMismatch(line, NULL);
+	}
+
+	if (golden.mismatches)
+		fprintf(stderr, "%s: %lu of %lu events differ\n",
+			golden.path, golden.mismatches, golden.events);
+	fclose(golden.file);
+}
+
+/*****************************************************************************
+ * Results
+ *
+ * One line per replay, tab separated, appended to a file so that runs of
+ * two builds can be lined up: the capture and model, what was replayed,
+ * the rates, then for each stage of the pipeline the times it ran, its
+ * ns per frame and per run. A frame is a state the parser handed to
+ * wcmEvent. A new file starts with a line naming the columns.
+ ****************************************************************************/
+
+static const char* stageNames[WCM_STAGES] =
+	{ "read", "parse", "filter", "dispatch", "post" };
+
+static int resultsWrite(const char* file, const char* path,
+	WacomCommonPtr common, unsigned long events, int64_t busy,
+	unsigned long allocs)
+{
+	WacomStageTime st[WCM_STAGES];
+	unsigned long frames;
+	FILE* out;
+	int i;
+
+	wcmStageSum(common, st);
+	frames = st[WCM_STAGE_FILTER].count;
+
+	out = fopen(file, "a");
+	if (!out)
+	{
+		fprintf(stderr, "%s: %s\n", file, strerror(errno));
+		return !Success;
+	}
+
+	if (!ftell(out))
+	{
+		fprintf(out, "capture\tmodel\treads\tframes\tevents"
+			"\tevents_per_sec\tns_per_frame\tallocs_per_frame");
+		for (i = 0; i < WCM_STAGES; i++)
+			fprintf(out, "\t%s_count\t%s_ns_per_frame\t%s_ns_per_run",
+				stageNames[i], stageNames[i], stageNames[i]);
+		fputc('\n', out);
+	}
+
+	fprintf(out, "%s\t%s\t%lu\t%lu\t%lu\t%.0f\t%.1f\t%.3f",
+		path, common->wcmModel ? common->wcmModel->name : "",
+		replay.reads, frames, events,
+		busy ? events * 1e9 / busy : 0.0,
+		frames ? (double)busy / frames : 0.0,
+		frames ? (double)allocs / frames : 0.0);
+	for (i = 0; i < WCM_STAGES; i++)
+		fprintf(out, "\t%lu\t%.1f\t%.1f", st[i].count,
+			frames ? (double)st[i].ns / frames : 0.0,
+			st[i].count ? (double)st[i].ns / st[i].count : 0.0);
+	fputc('\n', out);
+
+	if (fclose(out))
+	{
+		fprintf(stderr, "%s: %s\n", file, strerror(errno));
+		return !Success;
+	}
+	return Success;
+}
+
+/*****************************************************************************
+ * Main
+ ****************************************************************************/
+
+static void replaySleep(int64_t until)
+{
+	struct timespec ts;
+
+	ts.tv_sec = until / 1000000000;
+	ts.tv_nsec = until % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+			EINTR)
+		;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wcmreplay [options] capture\n"
+		"  -b file         append the results to file, see resultsWrite\n"
+		"  -c file         compare the posted events with file, written\n"
+		"                  by an earlier -e; exit with 2 if they differ\n"
+		"  -e file         write the posted events to file, - for stdout\n"
+		"  -o name=value   set a driver option on all devices\n"
+		"  -r              replay at the recorded speed, not as fast\n"
+		"                  as possible\n"
+		"  -s widthxheight screen size, default 1920x1080\n"
+		"  -t tolerance    how far valuators may be off for -c\n"
+		"  -v              print all driver messages\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* events = NULL;
+	const char* results = NULL;
+	const char* path;
+	pointer userOpts = NULL;
+	pointer options, opt;
+	LocalDevicePtr local;
+	FILE* report = stdout;
+	char name[128], *value;
+	int realtime = 0, width = 1920, height = 1080;
+	int i, c, devices = 0;
+	unsigned long total;
+	int64_t start = 0, t0 = 0, busy = 0;
+	unsigned long allocs;
+	int status = 0;
+
+	while ((c = getopt(argc, argv, "b:c:e:o:rs:t:v")) != -1)
+	{
+		switch (c)
+		{
+			case 'b':
+				results = optarg;
+				break;
+			case 'c':
+				golden.path = optarg;
+				break;
+			case 'e':
+				events = optarg;
+				break;
+			case 'o':
+				value = strchr(optarg, '=');
+				if (!value)
+				{
+					usage();
+					return 1;
+				}
+				*value++ = '\0';
+				userOpts = fakeOptionAdd(userOpts, optarg, value);
+				break;
+			case 'r':
+				realtime = 1;
+				break;
+			case 's':
+				if (sscanf(optarg, "%dx%d", &width, &height) != 2 ||
+						width <= 0 || height <= 0)
+				{
+					usage();
+					return 1;
+				}
+				break;
+			case 't':
+				golden.tolerance = atoi(optarg);
+				break;
+			case 'v':
+				fakeVerbose = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		usage();
+		return 1;
+	}
+	path = argv[optind];
+
+	if (replayLoad(path) != Success)
+		return 1;
+
+	if (events && !strcmp(events, "-"))
+	{
+		fakeEventLog = stdout;
+		report = stderr;
+	}
+	else if (events && !(fakeEventLog = fopen(events, "w")))
+	{
+		fprintf(stderr, "%s: %s\n", events, strerror(errno));
+		return 1;
+	}
+
+	if (golden.path)
+	{
+		golden.file = fopen(golden.path, "r");
+		if (!golden.file)
+		{
+			fprintf(stderr, "%s: %s\n", golden.path, strerror(errno));
+			return 1;
+		}
+		fakeEventHook = goldenCheck;
+	}
+
+	fakeScreenInit(width, height);
+	fakeSerial = &replaySerial;
+	/* the devices are set up when the tablet was opened */
+	if (!realtime)
+		fakeClockSet(replay.time_us);
+
+	/* one device per tool, the driver skips those the tablet doesn't
+	 * have; serial tablets tell their id in the name */
+	for (i = 0; i < ARRAY_SIZE(toolTypes); i++)
+	{
+		if (replay.hdr.device_class == WACOM_RECORD_ISDV4)
+			snprintf(name, sizeof(name), "Wacom ISDV4 WACf%03X %s",
+				replay.hdr.tablet_id, toolTypes[i]);
+		else
+			snprintf(name, sizeof(name), "Wacom %s %s",
+				replay.hdr.model, toolTypes[i]);
+
+		options = fakeOptionAdd(NULL, "Device", path);
+		options = fakeOptionAdd(options, "Type", toolTypes[i]);
+		for (opt = userOpts; opt; opt = xf86NextOption(opt))
+			options = fakeOptionAdd(options, xf86OptionName(opt),
+				xf86OptionValue(opt));
+
+		/* the capture is read here, one read at a time */
+		options = fakeOptionAdd(options, "Thread", "off");
+		options = fakeOptionAdd(options, "SharedReader", "off");
+		/* the results need the stage times */
+		options = fakeOptionAdd(options, "PipelineLatency", "on");
+
+		if (fakeDeviceAdd(&WACOM, name, options))
+			devices++;
+	}
+
+	local = fakeEnabledDevice(0);
+	if (!devices || !local)
+	{
+		fprintf(stderr, "%s: no device could be set up\n", path);
+		return 1;
+	}
+
+	/* what setting up allocated doesn't count */
+	allocs = fakeAllocCount;
+	while (local && replayNext())
+	{
+		int64_t now;
+
+		if (realtime)
+		{
+			if (!start)
+			{
+				start = fakeRealTime();
+				t0 = replay.time_us;
+			}
+			replaySleep(start + (replay.time_us - t0) * 1000);
+		}
+		else
+			fakeClockSet(replay.time_us);
+
+		now = fakeRealTime();
+		while (local && replay.pos < replay.len)
+		{
+			local->read_input(local);
+			local = fakeEnabledDevice(0);
+		}
+		fakeRunWorkProcs();
+		fakeRunBlockHandlers();
+		fakeRunTimers();
+		busy += fakeRealTime() - now;
+
+		local = fakeEnabledDevice(0);
+	}
+
+	if (!local)
+		fprintf(stderr, "%s: the device went away\n", path);
+	if (replay.reopens)
+		fprintf(stderr, "%s: skipped %lu later opens of the tablet\n",
+			path, replay.reopens);
+
+	total = 0;
+	for (i = 0; i < FAKE_EVENT_TYPES; i++)
+		total += fakeEventCount[i];
+
+	fprintf(report, "%s: %lu reads, %llu bytes, %lu events "
+		"(%lu motion, %lu proximity, %lu button, %lu key)\n",
+		path, replay.reads, replay.bytes, total,
+		fakeEventCount[FAKE_MOTION], fakeEventCount[FAKE_PROXIMITY],
+		fakeEventCount[FAKE_BUTTON], fakeEventCount[FAKE_KEY]);
+	if (total && busy)
+		fprintf(report, "%.0f events/sec, %.1f ns/event, "
+			"%.1f ns/read\n", total * 1e9 / busy,
+			(double)busy / total, (double)busy / replay.reads);
+
+	if (results && local && resultsWrite(results, path,
+			((WacomDevicePtr)local->private)->common, total, busy,
+			fakeAllocCount - allocs) != Success)
+		status = 1;
+
+	fakeClockRelease();
+	fakeDeviceRemoveAll();
+	if (fakeEventLog && fakeEventLog != stdout)
+		fclose(fakeEventLog);
+	fakeOptionFree(userOpts);
+	xfree(replay.data);
+	if (golden.file)
+		goldenFinish();
+	return golden.mismatches ? 2 : status;
+}
+/* vim: set noexpandtab shiftwidth=8: */
@@ -0,0 +1,324 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*****************************************************************************
+ * wcmringtest -- feed the reception ring the way wcmReadPacket does and
+ * check what the parsers are shown.
+ *
+ * Built against wcmRingBuffer.c alone. The packets are numbered, so the
+ * stand-in parsers can tell they saw each of them once, in order and in
+ * one piece, also where the packet wraps around the end of the ring and
+ * is only whole in the mirror. Reads come in odd sizes to split packets
+ * anywhere. Exits 1 if anything was off.
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "wcmRingBuffer.h"
+#include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_PACKETS 5000       /* packets fed per test */
+
+static int failures;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: ", __func__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			failures++; \
+		} \
+	} while (0)
+
+typedef struct
+{
+	const unsigned char* end;       /* end of the ring, the mirror follows */
+	unsigned int seq;               /* number of the next packet */
+	int wrapped;                    /* packets seen through the mirror */
+} ParseState;
+
+typedef struct
+{
+	const char* name;
+	int size;                       /* ring size */
+	int maxRead;                    /* largest read */
+	int wraps;                      /* packets have to wrap around */
+	int (*make)(unsigned char* pkt, unsigned int seq);
+	int (*parse)(ParseState* ps, const unsigned char* data, int len);
+} RingTest;
+
+/* the same reads for every run */
+static unsigned int ringRandom(unsigned int* state)
+{
+	*state = *state * 1103515245 + 12345;
+	return (*state >> 16) & 0x7fff;
+}
+
+/*****************************************************************************
+ * USB: struct input_events, usbParse takes as many whole ones as it is
+ * shown. The value tells the number.
+ ****************************************************************************/
+
+static int usbMake(unsigned char* pkt, unsigned int seq)
+{
+	struct input_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = EV_ABS;
+	ev.code = ABS_X;
+	ev.value = seq;
+	memcpy(pkt, &ev, sizeof(ev));
+	return sizeof(ev);
+}
+
+static int usbParse(ParseState* ps, const unsigned char* data, int len)
+{
+	int nevents = len / sizeof(struct input_event);
+	struct input_event ev;
+	int i;
+
+	for (i = 0; i < nevents; i++)
+	{
+		memcpy(&ev, data + i * sizeof(ev), sizeof(ev));
+		CHECK(ev.type == EV_ABS && ev.code == ABS_X &&
+			ev.value == (int)ps->seq,
+			"event %u: got type %d code %d value %d\n",
+			ps->seq, ev.type, ev.code, ev.value);
+		if (data + (i + 1) * sizeof(ev) > ps->end)
+			ps->wrapped++;
+		ps->seq++;
+	}
+	return nevents * sizeof(struct input_event);
+}
+
+/*****************************************************************************
+ * ISDV4: packets of the lengths the tablets send, only the first byte
+ * has the header bit. It also tells the length here, the rest counts up
+ * from the number.
+ ****************************************************************************/
+
+static const int isdv4Lengths[] = { 9, 5, 7, 11, 13, 9, 9 };
+
+static int isdv4Make(unsigned char* pkt, unsigned int seq)
+{
+	int len = isdv4Lengths[seq % (sizeof(isdv4Lengths) / sizeof(int))];
+	int i;
+
+	pkt[0] = 0x80 | len;
+	for (i = 1; i < len; i++)
+		pkt[i] = (seq + i) & 0x7f;
+	return len;
+}
+
+static int isdv4Parse(ParseState* ps, const unsigned char* data, int len)
+{
+	unsigned char pkt[16];
+	int n;
+
+	n = isdv4Make(pkt, ps->seq);
+	if (len < n)
+		return 0;
+
+	CHECK(!memcmp(data, pkt, n), "packet %u differs\n", ps->seq);
+	if (data + n > ps->end)
+		ps->wrapped++;
+	ps->seq++;
+	return n;
+}
+
+/*****************************************************************************
+ * ringRun --
+ *   Read a stream of packets into a ring and parse it like wcmReadPacket.
+ ****************************************************************************/
+
+static void ringRun(const RingTest* t)
+{
+	unsigned char next[32];
+	unsigned char* storage = calloc(1, t->size + RING_MIRROR_SIZE);
+	unsigned char* stream = malloc(TEST_PACKETS * sizeof(next));
+	unsigned int rnd = 1;
+	int total = 0, pos = 0, remaining, avail, view, n, cnt;
+	unsigned char* space;
+	const unsigned char* data;
+	WacomRing ring;
+	ParseState ps;
+	unsigned int i;
+
+	if (!storage || !stream)
+	{
+		fprintf(stderr, "%s: out of memory\n", t->name);
+		exit(1);
+	}
+
+	for (i = 0; i < TEST_PACKETS; i++)
+		total += t->make(stream + total, i);
+
+	wcmRingInit(&ring, storage, t->size);
+	memset(&ps, 0, sizeof(ps));
+	ps.end = storage + t->size;
+
+	while (pos < total)
+	{
+		space = wcmRingWriteSpace(&ring, &remaining);
+		CHECK(remaining > 0, "%s: no room with %d bytes pending\n",
+			t->name, wcmRingAvailable(&ring));
+		if (remaining <= 0)
+			break;
+
+		n = 1 + ringRandom(&rnd) % t->maxRead;
+		if (n > remaining)
+			n = remaining;
+		if (n > total - pos)
+			n = total - pos;
+		memcpy(space, stream + pos, n);
+		wcmRingCommit(&ring, n);
+		pos += n;
+
+		while (wcmRingAvailable(&ring))
+		{
+			data = wcmRingPeek(&ring, &avail);
+
+			/* all of it, or up to the end of the mirror */
+			view = storage + t->size + RING_MIRROR_SIZE - data;
+			if (view > wcmRingAvailable(&ring))
+				view = wcmRingAvailable(&ring);
+			CHECK(data >= storage && data < storage + t->size &&
+				avail == view, "%s: shown %d bytes at %d, "
+				"expected %d\n", t->name, avail,
+				(int)(data - storage), view);
+
+			cnt = t->parse(&ps, data, avail);
+			if (!cnt)
+			{
+				/* the parser must not starve on a packet
+				 * that is all there */
+				CHECK(wcmRingAvailable(&ring) <
+					t->make(next, ps.seq),
+					"%s: packet %u pending but not shown\n",
+					t->name, ps.seq);
+				break;
+			}
+			CHECK(cnt > 0 && cnt <= avail,
+				"%s: parser took %d of %d\n", t->name, cnt,
+				avail);
+			wcmRingConsume(&ring, cnt);
+		}
+	}
+
+	CHECK(ps.seq == TEST_PACKETS, "%s: parsed %u of %d packets\n",
+		t->name, ps.seq, TEST_PACKETS);
+	CHECK(!wcmRingAvailable(&ring), "%s: %d bytes left over\n",
+		t->name, wcmRingAvailable(&ring));
+	CHECK(t->wraps ? ps.wrapped > 0 : !ps.wrapped,
+		"%s: %d packets wrapped around\n", t->name, ps.wrapped);
+
+	printf("%s: %u packets, %d read through the mirror\n", t->name,
+		ps.seq, ps.wrapped);
+
+	free(stream);
+	free(storage);
+}
+
+/*****************************************************************************
+ * ringSplit --
+ *   One ISDV4 packet, read in two pieces, the second at the start of the
+ *   ring: it has to be shown whole, at its first byte.
+ ****************************************************************************/
+
+static void ringSplit(void)
+{
+	unsigned char storage[64 + RING_MIRROR_SIZE];
+	unsigned char pkt[16];
+	const unsigned char* data;
+	unsigned char* space;
+	int len, remaining;
+	WacomRing ring;
+
+	len = isdv4Make(pkt, 0);
+	wcmRingInit(&ring, storage, 64);
+
+	/* the first byte of the packet goes last in the ring but four */
+	space = wcmRingWriteSpace(&ring, &remaining);
+	CHECK(space == storage && remaining == 64,
+		"empty ring offers %d bytes at %d\n", remaining,
+		(int)(space - storage));
+	memset(space, 0, 59);
+	space[59] = pkt[0];
+	wcmRingCommit(&ring, 60);
+	wcmRingConsume(&ring, 59);
+
+	space = wcmRingWriteSpace(&ring, &remaining);
+	CHECK(space == storage + 60 && remaining == 4,
+		"offers %d bytes at %d, expected 4 at 60\n", remaining,
+		(int)(space - storage));
+	memcpy(space, pkt + 1, 4);
+	wcmRingCommit(&ring, 4);
+
+	data = wcmRingPeek(&ring, &remaining);
+	CHECK(remaining == 5, "half a packet shows as %d bytes\n", remaining);
+
+	space = wcmRingWriteSpace(&ring, &remaining);
+	CHECK(space == storage && remaining == 59,
+		"offers %d bytes at %d after the wrap, expected 59 at 0\n",
+		remaining, (int)(space - storage));
+	memcpy(space, pkt + 5, len - 5);
+	wcmRingCommit(&ring, len - 5);
+
+	data = wcmRingPeek(&ring, &remaining);
+	CHECK(data == storage + 59 && remaining == len &&
+		!memcmp(data, pkt, len),
+		"wrapped packet shows as %d bytes at %d\n", remaining,
+		(int)(data - storage));
+
+	wcmRingConsume(&ring, len);
+	space = wcmRingWriteSpace(&ring, &remaining);
+	CHECK(!wcmRingAvailable(&ring) && space == storage &&
+		remaining == 64, "drained ring offers %d bytes at %d\n",
+		remaining, (int)(space - storage));
+}
+
+int main(void)
+{
+	static const RingTest tests[] =
+	{
+		/* a ring of whole events, like the driver's, is emptied
+		 * before an event could wrap */
+		{ "usb", 8 * sizeof(struct input_event),
+			3 * sizeof(struct input_event), 0, usbMake, usbParse },
+		{ "usb-odd", 8 * sizeof(struct input_event) + 5,
+			3 * sizeof(struct input_event), 1, usbMake, usbParse },
+		{ "isdv4", 64, 40, 1, isdv4Make, isdv4Parse },
+		{ "isdv4-small", 2 * RING_MIRROR_SIZE, 13, 1, isdv4Make,
+			isdv4Parse },
+	};
+	unsigned int i;
+
+	ringSplit();
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+		ringRun(&tests[i]);
+
+	if (failures)
+	{
+		fprintf(stderr, "wcmringtest: %d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*****************************************************************************
+ * wcmtrace -- print a dump of the "Wacom Debug Trace" property the way
+ * the DBG() messages would have been logged.
+ *
+ * Each record is put back together from the format of its call site and
+ * the arguments that were kept. Arguments past WACOM_TRACE_ARGS were
+ * never recorded and show as "?", strings only by their first 8 bytes.
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "wacom-trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct
+{
+	WacomTraceHeader hdr;
+	WacomTraceRecord* recs;
+	char** strings;
+} Trace;
+
+static int traceLoad(Trace* t, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	uint32_t i, len;
+
+	if (!f)
+	{
+		perror(path);
+		return 0;
+	}
+
+	if (fread(&t->hdr, sizeof(t->hdr), 1, f) != 1 ||
+			strncmp(t->hdr.magic, WACOM_TRACE_MAGIC,
+				sizeof(t->hdr.magic)) ||
+			t->hdr.version != WACOM_TRACE_VERSION ||
+			t->hdr.record_size != sizeof(WacomTraceRecord))
+	{
+		fprintf(stderr, "%s: not a trace this tool can read\n", path);
+		goto fail;
+	}
+
+	t->recs = calloc(t->hdr.records + 1, sizeof(WacomTraceRecord));
+	t->strings = calloc(t->hdr.strings + 1, sizeof(char*));
+	if (!t->recs || !t->strings ||
+			fread(t->recs, sizeof(WacomTraceRecord), t->hdr.records,
+				f) != t->hdr.records)
+		goto truncated;
+
+	for (i = 0; i < t->hdr.strings; i++)
+	{
+		if (fread(&len, sizeof(len), 1, f) != 1)
+			goto truncated;
+		t->strings[i] = malloc(len + 1);
+		if (!t->strings[i] ||
+				fread(t->strings[i], 1, len, f) != len)
+			goto truncated;
+		t->strings[i][len] = '\0';
+	}
+
+	fclose(f);
+	return 1;
+
+truncated:
+	fprintf(stderr, "%s: truncated\n", path);
+fail:
+	fclose(f);
+	return 0;
+}
+
+static const char* traceString(const Trace* t, uint32_t index)
+{
+	return index < t->hdr.strings ? t->strings[index] : "?";
+}
+
+/*****************************************************************************
+ * tracePrint --
+ *   Print one record: its format with each conversion given the argument
+ *   that was recorded for it.
+ ****************************************************************************/
+
+static void tracePrint(const Trace* t, const WacomTraceRecord* r)
+{
+	const char* p = traceString(t, r->format);
+	char spec[32], str[sizeof(r->args[0]) + 1];
+	int longs, len, n = 0;
+	double d;
+
+	printf("[%lld.%06lld] %s (%s): ",
+		(long long)(r->time_ns / 1000000000),
+		(long long)(r->time_ns % 1000000000 / 1000),
+		traceString(t, r->name), traceString(t, r->func));
+
+	while (*p)
+	{
+		if (*p != '%' || p[1] == '%')
+		{
+			if (*p == '%')
+				p++;
+			putchar(*p++);
+			continue;
+		}
+
+		/* copy the spec without its length modifiers, the value
+		 * is printed from 64 bits anyway */
+		len = strspn(p + 1, "-+ #0123456789.") + 1;
+		if (len > (int)sizeof(spec) - 4)
+			len = sizeof(spec) - 4;
+		memcpy(spec, p, len);
+		p += len;
+		for (longs = 0; *p == 'l' || *p == 'z' || *p == 'h'; p++)
+			longs++;
+		if (!*p)
+			break;
+
+		if (n >= r->nargs)
+		{
+			fputs("?", stdout);
+			p++;
+			continue;
+		}
+
+		switch (*p)
+		{
+			case 'd': case 'i':
+				strcpy(spec + len, "lld");
+				printf(spec, (long long)r->args[n]);
+				break;
+			case 'c':
+				spec[len] = 'c';
+				spec[len + 1] = '\0';
+				printf(spec, (int)r->args[n]);
+				break;
+			case 'u': case 'x': case 'X': case 'o':
+				/* unsigned ints were zero extended */
+				spec[len] = 'l';
+				spec[len + 1] = 'l';
+				spec[len + 2] = *p;
+				spec[len + 3] = '\0';
+				printf(spec, (unsigned long long)r->args[n]);
+				break;
+			case 'p':
+				printf("0x%llx", (unsigned long long)r->args[n]);
+				break;
+			case 'e': case 'f': case 'g':
+				spec[len] = *p;
+				spec[len + 1] = '\0';
+				memcpy(&d, &r->args[n], sizeof(d));
+				printf(spec, d);
+				break;
+			case 's':
+				memcpy(str, &r->args[n], sizeof(r->args[n]));
+				str[sizeof(r->args[n])] = '\0';
+				spec[len] = 's';
+				spec[len + 1] = '\0';
+				printf(spec, str);
+				break;
+			default:
+				/* not something wcmTrace took an argument for */
+				fwrite(spec, 1, len, stdout);
+				p -= longs;
+				continue;
+		}
+		n++;
+		p++;
+	}
+
+	p = traceString(t, r->format);
+	if (!*p || p[strlen(p) - 1] != '\n')
+		putchar('\n');
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wcmtrace [options] trace\n"
+		"  -l level        only records up to this debug level\n"
+		"  -n name         only records of this device or tablet\n");
+}
+
+int main(int argc, char** argv)
+{
+	Trace t;
+	const char* name = NULL;
+	int level = 0;
+	uint32_t i;
+	int c;
+
+	while ((c = getopt(argc, argv, "l:n:")) != -1)
+	{
+		switch (c)
+		{
+			case 'l':
+				level = atoi(optarg);
+				break;
+			case 'n':
+				name = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind != argc - 1 || level < 0)
+	{
+		usage();
+		return 1;
+	}
+
+	memset(&t, 0, sizeof(t));
+	if (!traceLoad(&t, argv[optind]))
+		return 1;
+
+	for (i = 0; i < t.hdr.records; i++)
+	{
+		const WacomTraceRecord* r = &t.recs[i];
+
+		if (level && r->level > level)
+			continue;
+		if (name && strcmp(traceString(&t, r->name), name))
+			continue;
+		tracePrint(&t, r);
+	}
+	return 0;
+}
@@ -69,6 +69,9 @@
 /* BOOL, 1 value */
 #define WACOM_PROP_HOVER "Wacom Hover Click"
 
+/* 32 bit, 1 value, motion events per second, 0 for no limit */
+#define WACOM_PROP_EVENT_RATE "Wacom Max Event Rate"
+
 /* Atom, 1 value */
 #define WACOM_PROP_TOOL_TYPE "Wacom Tool Type"
 
@@ -78,10 +81,45 @@
  */
 #define WACOM_PROP_BUTTON_ACTIONS "Wacom Button Actions"
 
+/* 32 bit, 5 * 16 values. Per pipeline stage (read, parse, filter,
+ * dispatch, post) a histogram of how long the stage took for the tablet:
+ * value 0 counts runs under 1 microsecond, value n runs of
+ * [2^(n-1), 2^n) microseconds and value 15 all runs of 2^14 microseconds
+ * or more.
+ * Time spent in a later stage called from an earlier one is counted only
+ * for the later stage. The counts are updated whenever the property is
+ * read.
+ * The stages are only timed once the PipelineLatency option is set or
+ * the property is set to a single value of 1; until then all counts are
+ * 0. Setting it to a single value of 0 stops the timing and clears the
+ * counts.
+ */
+#define WACOM_PROP_PIPELINE_LATENCY "Wacom Pipeline Latency"
+
+/* 32 bit, 12 values, counts since the last reset: bytes read, packets
+ * parsed, states dropped by Suppress, states dropped by the raw filter,
+ * first USB states of a tool dropped, frames too large for the driver,
+ * SYN_DROPPED received and reads the parser gave up on, all for the
+ * tablet; then motion, button, key and proximity events posted by this
+ * device. Setting it to a single value of 0 resets the counts of the
+ * tablet and all its devices. The counts are updated whenever the
+ * property is read.
+ */
+#define WACOM_PROP_STATISTICS "Wacom Statistics"
+
 /* 8 bit, 2 values, priv->debugLevel and common->debugLevel. This property
  * is for use in the driver only and only enabled if --enable-debug is
  * given. No client may rely on this property being present or working.
  */
 #define WACOM_PROP_DEBUGLEVELS "Wacom Debug Levels"
 
+/* 8 bit, 2 values, trace level and dump. Debug messages up to the trace
+ * level, 0 for none, are recorded in an in-memory ring shared by all
+ * devices, independent of the debug levels; setting dump to 1 writes the
+ * ring to the "TraceFile" of the tablet, for the wcmtrace tool to decode.
+ * Dump always reads back as 0. Like the debug levels this property is
+ * only there with --enable-debug and no client may rely on it.
+ */
+#define WACOM_PROP_DEBUG_TRACE "Wacom Debug Trace"
+
 #endif
@@ -0,0 +1,84 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _WACOM_RECORD_H_
+#define _WACOM_RECORD_H_
+
+#include <stdint.h>
+
+/**
+ * Format of the files written with the "RecordFile" option.
+ *
+ * A record file is a sequence of chunks, each a WacomRecordChunk followed
+ * by len bytes of payload, in the byte order of the machine that wrote
+ * it. Every time the driver opens the tablet it appends a
+ * WACOM_RECORD_OPEN chunk, its payload a WacomRecordHeader; the
+ * WACOM_RECORD_DATA chunks after it hold exactly what one read() of the
+ * device returned.
+ */
+
+#define WACOM_RECORD_MAGIC "WCMREC"
+#define WACOM_RECORD_VERSION 1
+
+/* chunk types */
+#define WACOM_RECORD_OPEN 1     /* tablet opened, payload WacomRecordHeader */
+#define WACOM_RECORD_DATA 2     /* bytes read from the device */
+
+/* device classes */
+#define WACOM_RECORD_USB   1
+#define WACOM_RECORD_ISDV4 2
+
+#define WACOM_RECORD_KEY_BYTES 96   /* (KEY_MAX + 1) / 8 */
+#define WACOM_RECORD_ABS_AXES  64   /* ABS_MAX + 1 */
+
+typedef struct
+{
+	int64_t time_us;        /* CLOCK_MONOTONIC time of the read */
+	uint32_t type;          /* WACOM_RECORD_* chunk type */
+	uint32_t len;           /* bytes of payload following */
+} WacomRecordChunk;
+
+typedef struct
+{
+	char magic[8];          /* WACOM_RECORD_MAGIC, NUL padded */
+	uint32_t version;       /* WACOM_RECORD_VERSION */
+	uint32_t size;          /* sizeof(WacomRecordHeader) of the writer */
+
+	uint32_t device_class;  /* WACOM_RECORD_USB or _ISDV4 */
+	int32_t tablet_id;
+	int32_t protocol_level;
+	int32_t pkt_length;     /* packet length of serial tablets */
+	uint32_t flags;         /* common->wcmFlags */
+	char model[32];         /* wcmModel name, NUL terminated */
+
+	/* ranges as the driver sees them */
+	int32_t max_x, max_y, max_z;
+	int32_t max_touch_x, max_touch_y;
+	int32_t max_capacity, max_dist;
+	int32_t max_tilt_x, max_tilt_y;
+	int32_t max_strip_x, max_strip_y;
+	int32_t resol_x, resol_y;
+	int32_t touch_resol_x, touch_resol_y;
+
+	/* USB tablets: what the kernel device reports, zero otherwise */
+	uint16_t vendor, product;
+	uint8_t key_bits[WACOM_RECORD_KEY_BYTES];  /* EVIOCGBIT(EV_KEY) */
+	uint8_t abs_bits[WACOM_RECORD_ABS_AXES / 8]; /* EVIOCGBIT(EV_ABS) */
+	int32_t abs_min[WACOM_RECORD_ABS_AXES];   /* EVIOCGABS */
+	int32_t abs_max[WACOM_RECORD_ABS_AXES];
+} WacomRecordHeader;
+
+#endif /* _WACOM_RECORD_H_ */
@@ -0,0 +1,61 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _WACOM_TRACE_H_
+#define _WACOM_TRACE_H_
+
+#include <stdint.h>
+
+/**
+ * Format of the files written through the "Wacom Debug Trace" property.
+ *
+ * A trace file is a WacomTraceHeader, then that many WacomTraceRecords,
+ * oldest first, then the strings they refer to, each a uint32_t length
+ * followed by that many bytes without a terminating NUL. All of it is
+ * in the byte order of the machine that wrote it.
+ *
+ * A record is what one DBG() call site was given: the arguments its
+ * format string converts, up to WACOM_TRACE_ARGS of them. Integers are
+ * stored sign or zero extended, doubles by their bits and strings as
+ * their first 8 bytes, NUL padded. Only the format knows which is which.
+ */
+
+#define WACOM_TRACE_MAGIC "WCMTRC"
+#define WACOM_TRACE_VERSION 1
+
+#define WACOM_TRACE_ARGS 6
+
+typedef struct
+{
+	char magic[8];          /* WACOM_TRACE_MAGIC, NUL padded */
+	uint32_t version;       /* WACOM_TRACE_VERSION */
+	uint32_t record_size;   /* sizeof(WacomTraceRecord) of the writer */
+	uint32_t records;       /* records following */
+	uint32_t strings;       /* strings following the records */
+} WacomTraceHeader;
+
+typedef struct
+{
+	int64_t time_ns;        /* CLOCK_MONOTONIC time of the call */
+	uint32_t name;          /* device or tablet, index of a string */
+	uint32_t func;          /* function of the call site, likewise */
+	uint32_t format;        /* format string of the call site, likewise */
+	uint16_t level;         /* debug level of the call site */
+	uint16_t nargs;         /* arguments stored, at most WACOM_TRACE_ARGS */
+	int64_t args[WACOM_TRACE_ARGS];
+} WacomTraceRecord;
+
+#endif /* _WACOM_TRACE_H_ */
@@ -23,6 +23,7 @@
 
 #include "xf86Wacom.h"
 #include "Xwacom.h"
+#include "wcmFilter.h"
 #include <xkbsrv.h>
 
 void wcmInitialScreens(LocalDevicePtr local);
@@ -42,11 +43,15 @@ extern void xf86WcmFingerTapToClick(WacomCommonPtr common);
  ****************************************************************************/
  
 static void transPressureCurve(WacomDevicePtr pDev, WacomDeviceStatePtr pState);
-static void commonDispatchDevice(WacomCommonPtr common, unsigned int channel, 
-	const WacomChannelPtr pChannel, int suppress);
 static void resetSampleCounter(const WacomChannelPtr pChannel);
 static void sendAButton(LocalDevicePtr local, int button, int mask,
 		int rx, int ry, int rz, int v3, int v4, int v5);
+static void wcmPostEvents(LocalDevicePtr local, const WacomDeviceState* ds);
+static void wcmPostState(LocalDevicePtr local, const WacomDeviceState* ds);
+static void wcmFilterState(WacomCommonPtr common, unsigned int channel,
+	const WacomDeviceState* pState);
+static void wcmDispatchState(WacomCommonPtr common, unsigned int channel,
+	WacomDeviceState* ds, int suppress);
 
 /*****************************************************************************
  * wcmMappingFactor --
@@ -332,8 +337,10 @@ static int ODDKEYSYM [][2] =
 	{ 0, 0}
 };
 
-static void emitKeysym (DeviceIntPtr keydev, int keysym, int state)
+void emitKeysym (DeviceIntPtr keydev, int keysym, int state)
 {
+	LocalDevicePtr local = (LocalDevicePtr)keydev->public.devicePrivate;
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
 	int i, j, alt_keysym = 0;
 
 	/* Now that we have the keycode look for key index */
@@ -343,6 +350,7 @@ static void emitKeysym (DeviceIntPtr keydev, int keysym, int state)
 	KeySymsRec *ksr = &keydev->key->curKeySyms;
 #endif
 
+	priv->posted[WCM_POSTED_KEY]++;
 	for (i = ksr->minKeyCode; i <= ksr->maxKeyCode; i++)
 		if (ksr->map [(i - ksr->minKeyCode) * ksr->mapWidth] == keysym)
 			break;
@@ -472,6 +480,7 @@ static void sendAButton(LocalDevicePtr local, int button, int mask,
 		/* No button action configured, send button */
 		xf86PostButtonEvent(local->dev, is_absolute, priv->button[button], (mask != 0), 0, naxes,
 				    rx, ry, rz, v3, v4, v5);
+		priv->posted[WCM_POSTED_BUTTON]++;
 		return;
 	}
 
@@ -493,6 +502,7 @@ static void sendAButton(LocalDevicePtr local, int button, int mask,
 							    is_absolute, btn_no,
 							    is_press, 0, naxes,
 							    rx, ry, rz, v3, v4, v5);
+					priv->posted[WCM_POSTED_BUTTON]++;
 				}
 				break;
 			case AC_KEY:
@@ -518,6 +528,7 @@ static void sendAButton(LocalDevicePtr local, int button, int mask,
 						    1,1,0,naxes, rx,ry,rz,v3,v4,v5);
 				xf86PostButtonEvent(local->dev, is_absolute,
 						    1,0,0,naxes,rx,ry,rz,v3,v4,v5);
+				priv->posted[WCM_POSTED_BUTTON] += 4;
 				break;
 			case AC_DISPLAYTOGGLE:
 				toggleDisplay(local);
@@ -542,10 +553,13 @@ static void sendAButton(LocalDevicePtr local, int button, int mask,
 
 					if (countPresses(btn_no, &priv->keys[button][i],
 							ARRAY_SIZE(priv->keys[button]) - i))
+					{
 						xf86PostButtonEvent(local->dev,
 								is_absolute, btn_no,
 								0, 0, naxes,
 								rx, ry, rz, v3, v4, v5);
+						priv->posted[WCM_POSTED_BUTTON]++;
+					}
 				}
 				break;
 			case AC_KEY:
@@ -681,6 +695,7 @@ static void sendWheelStripEvents(LocalDevicePtr local, const WacomDeviceState* d
 
 		xf86PostButtonEvent(local->dev, is_absolute, fakeButton & AC_CODE,
 			0,0,naxes,x,y,z,v3,v4,v5);
+		priv->posted[WCM_POSTED_BUTTON] += 2;
 	    break;
 
 	    case AC_KEY:
@@ -707,6 +722,10 @@ static void sendCommonEvents(LocalDevicePtr local, const WacomDeviceState* ds, i
 	if (priv->oldButtons != buttons || (!priv->oldProximity && !buttons))
 		xf86WcmSendButtons(local,buttons,x,y,z,v3,v4,v5);
 
+	/* wheel and strip values are unchanged since they were last sent */
+	if (priv->oldProximity && !(ds->changed & (WCM_CHANGED_WHEEL | WCM_CHANGED_STRIP)))
+		return;
+
 	/* emulate wheel/strip events when defined */
 	if ( ds->relwheel || ds->abswheel || 
 		( (ds->stripx - priv->oldStripX) && ds->stripx && priv->oldStripX) || 
@@ -741,12 +760,132 @@ void wcmRotateCoordinates(LocalDevicePtr local, int* x, int* y)
 	}
 }
 
+/*****************************************************************************
+ * wcmHeldEventTimer --
+ *   Post the motion the rate limit held back once its time has come. The
+ *   timer isn't cancelled when held motion is superseded, so it may fire
+ *   early for motion held later; it then waits for that.
+ ****************************************************************************/
+
+static CARD32 wcmHeldEventTimer(OsTimerPtr timer, CARD32 time, pointer arg)
+{
+	LocalDevicePtr local = arg;
+	WacomDevicePtr priv = (WacomDevicePtr) local->private;
+	int sigstate = xf86BlockSIGIO();
+	CARD32 next = 0;
+	int64_t now;
+
+	priv->eventArmed = 0;
+	if (priv->eventHeld)
+	{
+		now = wcmGetTimeInMicros();
+		if (now < priv->eventDue)
+		{
+			priv->eventArmed = 1;
+			next = (CARD32)((priv->eventDue - now + 999) / 1000);
+		}
+		else
+		{
+			priv->eventHeld = 0;
+			priv->lastEventTime = now;
+			wcmPostEvents(local, &priv->heldState);
+		}
+	}
+
+	xf86UnblockSIGIO(sigstate);
+	return next;
+}
+
+/*****************************************************************************
+ * wcmHeldBlockHandler --
+ *   Set the timer for motion held back since the server last blocked.
+ *   xf86WcmSendEvents runs from the SIGIO handler, where the timer list
+ *   can't be touched, so it only holds the motion.
+ ****************************************************************************/
+
+void wcmHeldBlockHandler(pointer data, OSTimePtr pTimeout, pointer pReadmask)
+{
+	LocalDevicePtr local = data;
+	WacomDevicePtr priv = (WacomDevicePtr) local->private;
+	int sigstate;
+	int64_t wait;
+
+	if (!priv->eventHeld || priv->eventArmed)
+		return;
+
+	sigstate = xf86BlockSIGIO();
+	if (priv->eventHeld && !priv->eventArmed)
+	{
+		wait = priv->eventDue - wcmGetTimeInMicros();
+		priv->eventArmed = 1;
+		TimerSet(priv->eventTimer, 0,
+			wait > 0 ? (CARD32)((wait + 999) / 1000) : 1,
+			wcmHeldEventTimer, local);
+	}
+	xf86UnblockSIGIO(sigstate);
+}
+
 /*****************************************************************************
  * xf86WcmSendEvents --
- *   Send events according to the device state.
+ *   Send events according to the device state. With a MaxEventRate, motion
+ *   coming in faster than that is held back and only the latest of it is
+ *   posted when the interval is over. Anything else is posted right away
+ *   and supersedes held motion.
  ****************************************************************************/
 
 void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds)
+{
+	WacomDevicePtr priv = (WacomDevicePtr) local->private;
+	int64_t now, interval;
+
+	if (!priv->maxEventRate)
+	{
+		wcmPostEvents(local, ds);
+		return;
+	}
+
+	now = wcmGetTimeInMicros();
+	interval = 1000000 / priv->maxEventRate;
+
+	if (ds->device_type == PAD_ID || !ds->proximity ||
+			!priv->oldProximity || ds->relwheel ||
+			ds->device_id != priv->old_device_id ||
+			(int)ds->serial_num != priv->old_serial ||
+			ds->buttons != priv->oldButtons ||
+			ds->abswheel != priv->oldWheel ||
+			ds->stripx != priv->oldStripX ||
+			ds->stripy != priv->oldStripY ||
+			now - priv->lastEventTime >= interval)
+	{
+		/* supersedes held motion, a set timer finds none */
+		priv->eventHeld = 0;
+		priv->lastEventTime = now;
+		wcmPostEvents(local, ds);
+		return;
+	}
+
+	/* wcmHeldBlockHandler sets the timer */
+	priv->heldState = *ds;
+	priv->eventDue = priv->lastEventTime + interval;
+	priv->eventHeld = 1;
+}
+
+/*****************************************************************************
+ * wcmPostEvents --
+ *   Post the events for a device state.
+ ****************************************************************************/
+
+static void wcmPostEvents(LocalDevicePtr local, const WacomDeviceState* ds)
+{
+	WacomDevicePtr priv = (WacomDevicePtr) local->private;
+	WacomStageMark mark;
+
+	wcmStageEnter(priv->common, &mark);
+	wcmPostState(local, ds);
+	wcmStageLeave(priv->common, WCM_STAGE_POST, &mark);
+}
+
+static void wcmPostState(LocalDevicePtr local, const WacomDeviceState* ds)
 {
 #ifdef DEBUG
 	int is_button = !!(ds->buttons);
@@ -915,12 +1054,18 @@ void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds)
 
 			/* don't emit proximity events if device does not support proximity */
 			if ((local->dev->proximity && !priv->oldProximity))
+			{
 				xf86PostProximityEvent(local->dev, 1, 0, naxes, x, y, z, v3, v4, v5);
+				priv->posted[WCM_POSTED_PROXIMITY]++;
+			}
 
 			/* Move the cursor to where it should be before sending button events */
 			if(!(priv->flags & BUTTONS_ONLY_FLAG))
+			{
 				xf86PostMotionEvent(local->dev, is_absolute,
 					0, naxes, x, y, z, v3, v4, v5);
+				priv->posted[WCM_POSTED_MOTION]++;
+			}
 
 			sendCommonEvents(local, ds, x, y, z, v3, v4, v5);
 		}
@@ -943,7 +1088,10 @@ void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds)
 				xf86WcmSendButtons(local,0,x,y,z,v3,v4,v5);
 
 			if (priv->oldProximity && local->dev->proximity)
+			{
 				xf86PostProximityEvent(local->dev,0,0,naxes,x,y,z,v3,v4,v5);
+				priv->posted[WCM_POSTED_PROXIMITY]++;
+			}
 		} /* not in proximity */
 	}
 	else
@@ -957,7 +1105,10 @@ void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds)
 
 			/* don't emit proximity events if device does not support proximity */
 			if ((local->dev->proximity && !priv->oldProximity))
-			xf86PostProximityEvent(local->dev, 1, 0, naxes, x, y, z, v3, v4, v5);
+			{
+				xf86PostProximityEvent(local->dev, 1, 0, naxes, x, y, z, v3, v4, v5);
+				priv->posted[WCM_POSTED_PROXIMITY]++;
+			}
 
 			sendCommonEvents(local, ds, x, y, z, v3, v4, v5);
 			is_proximity = 1;
@@ -968,6 +1119,7 @@ void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds)
 			{
 	 			xf86PostMotionEvent(local->dev, is_absolute,
 					0, naxes, x, y, z, v3, v4, v5);
+				priv->posted[WCM_POSTED_MOTION]++;
 			}
 		}
 		else
@@ -976,8 +1128,11 @@ void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds)
 				xf86WcmSendButtons(local, buttons, 
 					x, y, z, v3, v4, v5);
 			if (priv->oldProximity && local->dev->proximity)
+			{
  				xf86PostProximityEvent(local->dev, 0, 0, naxes, 
 				x, y, z, v3, v4, v5);
+				priv->posted[WCM_POSTED_PROXIMITY]++;
+			}
 			is_proximity = 0;
 		}
 	}
@@ -1020,45 +1175,62 @@ void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds)
 /*****************************************************************************
  * wcmCheckSuppress --
  *  Determine whether device state has changed enough - return 0
- *  if not.
+ *  if not. Only the fields flagged in dsNew->changed are compared.
  ****************************************************************************/
 
 static int wcmCheckSuppress(WacomCommonPtr common, const WacomDeviceState* dsOrig,
 	WacomDeviceState* dsNew)
 {
 	int suppress = common->wcmSuppress;
+	int changed = dsNew->changed;
 	/* NOTE: Suppression value of zero disables suppression. */
 	int returnV = 0;
 
-	if (dsOrig->buttons != dsNew->buttons) returnV = 1;
+	if (changed & WCM_CHANGED_BUTTONS)
+		if (dsOrig->buttons != dsNew->buttons) returnV = 1;
 	if (dsOrig->proximity != dsNew->proximity) returnV = 1;
-	if (dsOrig->stripx != dsNew->stripx) returnV = 1;
-	if (dsOrig->stripy != dsNew->stripy) returnV = 1;
-	if (ABS(dsOrig->tiltx - dsNew->tiltx) > suppress) returnV = 1;
-	if (ABS(dsOrig->tilty - dsNew->tilty) > suppress) returnV = 1;
-	if (ABS(dsOrig->pressure - dsNew->pressure) > suppress) returnV = 1;
-	if (ABS(dsOrig->capacity - dsNew->capacity) > suppress) returnV = 1;
-	if (ABS(dsOrig->throttle - dsNew->throttle) > suppress) returnV = 1;
-	if (ABS(dsOrig->rotation - dsNew->rotation) > suppress &&
-		(1800 - ABS(dsOrig->rotation - dsNew->rotation)) >  suppress) returnV = 1;
+	if (changed & WCM_CHANGED_STRIP)
+	{
+		if (dsOrig->stripx != dsNew->stripx) returnV = 1;
+		if (dsOrig->stripy != dsNew->stripy) returnV = 1;
+	}
+	if (changed & WCM_CHANGED_TILT)
+	{
+		if (ABS(dsOrig->tiltx - dsNew->tiltx) > suppress) returnV = 1;
+		if (ABS(dsOrig->tilty - dsNew->tilty) > suppress) returnV = 1;
+	}
+	if (changed & WCM_CHANGED_PRESSURE)
+		if (ABS(dsOrig->pressure - dsNew->pressure) > suppress) returnV = 1;
+	if (changed & WCM_CHANGED_CAPACITY)
+		if (ABS(dsOrig->capacity - dsNew->capacity) > suppress) returnV = 1;
+	if (changed & WCM_CHANGED_THROTTLE)
+		if (ABS(dsOrig->throttle - dsNew->throttle) > suppress) returnV = 1;
+	if (changed & WCM_CHANGED_ROTATION)
+		if (ABS(dsOrig->rotation - dsNew->rotation) > suppress &&
+			(1800 - ABS(dsOrig->rotation - dsNew->rotation)) >  suppress) returnV = 1;
 
 	/* look for change in absolute wheel position 
 	 * or any relative wheel movement
 	 */
-	if ((ABS(dsOrig->abswheel - dsNew->abswheel) > suppress) 
-		|| (dsNew->relwheel != 0)) returnV = 1;
+	if (changed & WCM_CHANGED_WHEEL)
+		if ((ABS(dsOrig->abswheel - dsNew->abswheel) > suppress) 
+			|| (dsNew->relwheel != 0)) returnV = 1;
 
 	/* cursor moves or not? */
-	if ((ABS(dsOrig->x - dsNew->x) > suppress) || 
-			(ABS(dsOrig->y - dsNew->y) > suppress)) 
-	{
-		if (!returnV) /* need to check if cursor moves or not */
-			returnV = 2;
-	}
-	else /* don't move cursor */
+	if (changed & (WCM_CHANGED_X | WCM_CHANGED_Y))
 	{
-		dsNew->x = dsOrig->x;
-		dsNew->y = dsOrig->y;
+		if ((ABS(dsOrig->x - dsNew->x) > suppress) || 
+				(ABS(dsOrig->y - dsNew->y) > suppress)) 
+		{
+			if (!returnV) /* need to check if cursor moves or not */
+				returnV = 2;
+		}
+		else /* don't move cursor */
+		{
+			dsNew->x = dsOrig->x;
+			dsNew->y = dsOrig->y;
+			dsNew->changed &= ~(WCM_CHANGED_X | WCM_CHANGED_Y);
+		}
 	}
 
 	DBG(10, common, "level = %d"
@@ -1066,6 +1238,69 @@ static int wcmCheckSuppress(WacomCommonPtr common, const WacomDeviceState* dsOri
 	return returnV;
 }
 
+/*****************************************************************************
+ * wcmIsMotion --
+ *   Whether dsNew only moves the tool on from dsLast: no proximity, tool,
+ *   button, wheel or strip change, and pressure doesn't cross the button 1
+ *   threshold. Such a state can be merged into the next one.
+ ****************************************************************************/
+
+static int wcmIsMotion(WacomCommonPtr common, const WacomDeviceState* dsLast,
+	const WacomDeviceState* dsNew)
+{
+	int off = common->wcmThreshold - common->wcmMaxZ / 125;
+
+	if (dsNew->changed & (WCM_CHANGED_TOOL | WCM_CHANGED_BUTTONS |
+			WCM_CHANGED_WHEEL | WCM_CHANGED_STRIP |
+			WCM_CHANGED_CAPACITY))
+		return 0;
+
+	/* pads have nothing but transitions, gestures look at the
+	 * history of the touch channels */
+	if (!dsNew->proximity || dsNew->relwheel ||
+			dsNew->device_type == PAD_ID ||
+			(dsNew->device_type == TOUCH_ID && common->wcmGesture))
+		return 0;
+
+	if (dsNew->changed & WCM_CHANGED_PRESSURE)
+	{
+		if (dsNew->pressure >= common->wcmThreshold)
+			return dsLast->pressure >= common->wcmThreshold;
+		if (dsNew->pressure < off)
+			return dsLast->pressure < off;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*****************************************************************************
+ * wcmFlushCoalesced --
+ *   Dispatch the motion held back while overloaded, at the end of a read
+ *   loop.
+ ****************************************************************************/
+
+void wcmFlushCoalesced(WacomCommonPtr common)
+{
+	WacomChannelPtr pChannel;
+	int suppress, channel;
+
+	for (channel = 0; channel < MAX_CHANNELS; channel++)
+	{
+		pChannel = common->wcmChannel + channel;
+		if (!(suppress = pChannel->coalesce))
+			continue;
+
+		pChannel->coalesce = 0;
+		if (common->wcmThread)
+			wcmThreadQueue(common, channel,
+				&pChannel->valid.state, suppress);
+		else
+			commonDispatchDevice(common, channel,
+				&pChannel->valid.state, suppress);
+	}
+}
+
 /* reset raw data counters for filters */
 static void resetSampleCounter(const WacomChannelPtr pChannel)
 {
@@ -1074,6 +1309,7 @@ static void resetSampleCounter(const WacomChannelPtr pChannel)
 	{
 		pChannel->nSamples = 0;
 		pChannel->rawFilter.npoints = 0;
+		pChannel->rawFilter.tiltsettled = 0;
 		pChannel->rawFilter.statex = 0;
 		pChannel->rawFilter.statey = 0;
 	}
@@ -1086,12 +1322,22 @@ static void resetSampleCounter(const WacomChannelPtr pChannel)
 
 void wcmEvent(WacomCommonPtr common, unsigned int channel,
 	const WacomDeviceState* pState)
+{
+	WacomStageMark mark;
+
+	wcmStageEnter(common, &mark);
+	wcmFilterState(common, channel, pState);
+	wcmStageLeave(common, WCM_STAGE_FILTER, &mark);
+}
+
+static void wcmFilterState(WacomCommonPtr common, unsigned int channel,
+	const WacomDeviceState* pState)
 {
 	WacomDeviceState* pLast;
 	WacomDeviceState ds;
 	WacomChannelPtr pChannel;
 	WacomFilterState* fs;
-	int i, suppress = 0;
+	int suppress = 0, motion;
 
 	pChannel = common->wcmChannel + channel;
 	pLast = &pChannel->valid.state;
@@ -1106,12 +1352,23 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 	 * will need to change the values (ie. for error correction) */
 	ds = *pState;
 
-	/* timestamp the state for velocity and acceleration analysis */
-	ds.sample = (int)GetTimeInMillis();
+	/* add what changed in samples discarded since the last valid
+	 * state; a tool or proximity change invalidates all of it */
+	ds.changed |= pChannel->changed;
+	if (ds.proximity != pLast->proximity ||
+			ds.device_type != pLast->device_type)
+		ds.changed = WCM_CHANGED_ALL;
+	pChannel->changed = ds.changed;
+
+	/* timestamp the state for velocity and acceleration analysis,
+	 * with the time the tablet reported it where the parser knows */
+	if (!ds.time_us)
+		ds.time_us = wcmGetTimeInMicros();
+	ds.sample = (int)(ds.time_us / 1000);
 	DBG(10, common,
 		"c=%d i=%d t=%d s=%u x=%d y=%d b=%d "
 		"p=%d rz=%d tx=%d ty=%d aw=%d rw=%d "
-		"t=%d df=%d px=%d st=%d cs=%d \n",
+		"t=%d df=%d px=%d st=%d cs=%d ch=%x\n",
 		channel,
 		ds.device_id,
 		ds.device_type,
@@ -1120,7 +1377,7 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 		ds.pressure, ds.rotation, ds.tiltx,
 		ds.tilty, ds.abswheel, ds.relwheel, ds.throttle,
 		ds.discard_first, ds.proximity, ds.sample,
-		pChannel->nSamples);
+		pChannel->nSamples, ds.changed);
 
 	/* Discard the first 2 USB packages due to events delay */
 	if ( (pChannel->nSamples < 2) && (common->wcmDevCls == &gWacomUSBDevice) && 
@@ -1130,13 +1387,20 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 			"discarded %dth USB data.\n",
 			pChannel->nSamples);
 		++pChannel->nSamples;
+		common->wcmStats[WCM_STAT_FIRST]++;
 		return; /* discard */
 	}
 
 	if (strstr(common->wcmModel->name, "Intuos4"))
 	{
 		/* convert Intuos4 mouse tilt to rotation */
-		wcmTilt2R(&ds);
+		if (ds.changed & WCM_CHANGED_TILT)
+		{
+			wcmTilt2R(&ds);
+			ds.changed |= WCM_CHANGED_ROTATION;
+		}
+		else
+			ds.rotation = pLast->rotation;
 	}
 
 	fs = &pChannel->rawFilter;
@@ -1144,53 +1408,66 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 	{
 		DBG(11, common, "initialize Channel data.\n");
 		/* store channel device state for later use */
-		for (i=common->wcmRawSample - 1; i>=0; i--)
-		{
-			fs->x[i]= ds.x;
-			fs->y[i]= ds.y;
-			fs->tiltx[i] = ds.tiltx;
-			fs->tilty[i] = ds.tilty;
-		}
+		wcmFilterInit(common, fs, &ds);
+		fs->tiltsettled = common->wcmRawSample;
 		++fs->npoints;
 	} else  {
-		/* Filter raw data, fix hardware defects, perform error correction */
-		for (i=common->wcmRawSample - 1; i>0; i--)
-		{
-			fs->x[i]= fs->x[i-1];
-			fs->y[i]= fs->y[i-1];
-		}
-		fs->x[0] = ds.x;
-		fs->y[0] = ds.y;
-		if (HANDLE_TILT(common) && (ds.device_type == STYLUS_ID || ds.device_type == ERASER_ID))
+		int tilt = HANDLE_TILT(common) &&
+			(ds.device_type == STYLUS_ID || ds.device_type == ERASER_ID);
+
+		/* the averaged tilt keeps moving until the history holds
+		 * a single value */
+		if (tilt)
 		{
-			for (i=common->wcmRawSample - 1; i>0; i--)
-			{
-				fs->tiltx[i]= fs->tiltx[i-1];
-				fs->tilty[i]= fs->tilty[i-1];
-			}
-			fs->tiltx[0] = ds.tiltx;
-			fs->tilty[0] = ds.tilty;
+			if (pState->changed & WCM_CHANGED_TILT)
+				fs->tiltsettled = 0;
+			else if (fs->tiltsettled < common->wcmRawSample)
+				++fs->tiltsettled;
 		}
+
+		/* Filter raw data, fix hardware defects, perform error correction */
+		wcmFilterAdd(common, fs, &ds, tilt);
 		if (RAW_FILTERING(common) && common->wcmModel->FilterRaw && ds.device_type != PAD_ID)
 		{
 			if (common->wcmModel->FilterRaw(common,pChannel,&ds))
 			{
 				DBG(10, common,
 					"Raw filtering discarded data.\n");
+				common->wcmStats[WCM_STAT_FILTERED]++;
 				resetSampleCounter(pChannel);
 				return; /* discard */
 			}
+			/* averaged values keep moving after the raw ones stop */
+			ds.changed |= WCM_CHANGED_X | WCM_CHANGED_Y;
+			if (fs->tiltsettled < common->wcmRawSample)
+				ds.changed |= WCM_CHANGED_TILT;
 		}
 
 		/* Discard unwanted data */
 		suppress = wcmCheckSuppress(common, pLast, &ds);
 		if (!suppress)
 		{
+			common->wcmStats[WCM_STAT_SUPPRESSED]++;
+			/* the suppressed cursor move stays pending too */
+			pChannel->changed |= ds.changed;
 			resetSampleCounter(pChannel);
 			return;
 		}
 	}
 
+	/* a suppressed cursor move is still pending */
+	pChannel->changed &= ~ds.changed;
+
+	/* while overloaded, motion may be held back for a newer state;
+	 * a state that isn't motion supersedes it and goes out now */
+	motion = suppress && common->wcmOverload &&
+		wcmIsMotion(common, pLast, &ds);
+	if (pChannel->coalesce)
+	{
+		pChannel->coalesce = 0;
+		common->wcmCoalesced++;
+	}
+
 	/* JEJ - Do not move this code without discussing it with me.
 	 * The device state is invariant of any filtering performed below.
 	 * Changing the device state after this point can and will cause
@@ -1245,8 +1522,13 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 		}
 	}
 
-	/* everything else falls here */
-	commonDispatchDevice(common,channel,pChannel, suppress);
+	/* everything else falls here; in threaded mode the server does it */
+	if (motion)
+		pChannel->coalesce = suppress;
+	else if (common->wcmThread)
+		wcmThreadQueue(common, channel, &pChannel->valid.state, suppress);
+	else
+		commonDispatchDevice(common, channel, &pChannel->valid.state, suppress);
 ret:
 	resetSampleCounter(pChannel);
 }
@@ -1290,13 +1572,27 @@ static int idtotype(int id)
 	return type;
 }
 
-static void commonDispatchDevice(WacomCommonPtr common, unsigned int channel,
-	const WacomChannelPtr pChannel, int suppress)
+/*****************************************************************************
+ * commonDispatchDevice --
+ *   Find the device a valid state belongs to and send it there.
+ ****************************************************************************/
+
+void commonDispatchDevice(WacomCommonPtr common, unsigned int channel,
+	WacomDeviceState* ds, int suppress)
+{
+	WacomStageMark mark;
+
+	wcmStageEnter(common, &mark);
+	wcmDispatchState(common, channel, ds, suppress);
+	wcmStageLeave(common, WCM_STAGE_DISPATCH, &mark);
+}
+
+static void wcmDispatchState(WacomCommonPtr common, unsigned int channel,
+	WacomDeviceState* ds, int suppress)
 {
 	LocalDevicePtr pDev = NULL;
 	WacomToolPtr tool = NULL;
 	WacomToolPtr tooldef = NULL;
-	WacomDeviceState* ds = &pChannel->valid.states[0];
 	WacomDevicePtr priv = NULL;
 
 	if (!ds->device_type && ds->proximity)
@@ -1424,7 +1720,7 @@ static void commonDispatchDevice(WacomCommonPtr common, unsigned int channel,
 	 * settings, and send event to XInput */
 	if (pDev)
 	{
-		WacomDeviceState filtered = pChannel->valid.state;
+		WacomDeviceState filtered = *ds;
 
 		/* Device transformations come first */
 		/* button 1 Threshold test */
@@ -1488,6 +1784,23 @@ static void commonDispatchDevice(WacomCommonPtr common, unsigned int channel,
 			}
 			/* transform pressure */
 			transPressureCurve(priv,&filtered);
+
+			/* hovering motion goes out at wcmHoverRate at most,
+			 * contact and button changes right away */
+			if (common->wcmHoverRate && ds->proximity &&
+				priv->oldProximity && !filtered.buttons &&
+				!priv->oldButtons &&
+				ds->pressure < common->wcmThreshold &&
+				ds->abswheel == priv->oldWheel &&
+				ds->device_id == priv->old_device_id &&
+				ds->time_us - priv->hoverTime <
+					1000000 / common->wcmHoverRate)
+			{
+				common->wcmHoverDecimated++;
+				DBG(10, common, "Decimated hover data\n");
+				return;
+			}
+			priv->hoverTime = ds->time_us;
 		}
 
 		/* touch capacity is supported */
@@ -66,6 +66,11 @@ static int xf86WcmAllocate(LocalDevicePtr local, char* type_name, int flag)
 	if (!area)
 		goto error;
 
+	/* set from the server's block handler only, see wcmHeldBlockHandler */
+	priv->eventTimer = TimerSet(NULL, 0, 0, NULL, NULL);
+	if (!priv->eventTimer)
+		goto error;
+
 	local->type_name = type_name;
 	local->flags = 0;
 	local->device_control = gWacomModule.DevProc;
@@ -152,6 +157,16 @@ static int xf86WcmAllocate(LocalDevicePtr local, char* type_name, int flag)
 			/* transmit position if increment is superior */
 	common->wcmRawSample = DEFAULT_SAMPLES;    
 			/* number of raw data to be used to for filtering */
+	common->wcmReadBudget = DEFAULT_READ_BUDGET;
+			/* number of reads allowed per wakeup */
+	common->wcmThreaded = 0;
+			/* read the device in the server, not a thread */
+	common->wcmShared = 0;
+			/* with a descriptor of its own */
+	common->wcmOverloadThreshold = 0;
+			/* never coalesce motion */
+	common->wcmHoverRate = 0;
+			/* hover at the rate the tablet reports */
 
 	/* tool */
 	priv->tool = tool;
@@ -168,6 +183,8 @@ static int xf86WcmAllocate(LocalDevicePtr local, char* type_name, int flag)
 	return 1;
 
 error:
+	if (priv)
+		TimerFree(priv->eventTimer);
 	xfree(area);
 	xfree(tool);
 	xfree(common);
@@ -221,6 +238,35 @@ static const char *default_options[] =
 	NULL
 };
 
+/* xf86WcmFreeCommon - free the common structure, its tools and their
+ * areas once no device uses it any more. wcmDevice is left alone, the
+ * debug trace may still name the tablet by it. */
+
+static void xf86WcmFreeCommon(WacomCommonPtr common)
+{
+	WacomToolPtr tool;
+	WacomToolAreaPtr area;
+
+	while ((tool = common->wcmTool))
+	{
+		common->wcmTool = tool->next;
+		while ((area = tool->arealist))
+		{
+			tool->arealist = area->next;
+			xfree(area);
+		}
+		xfree(tool);
+	}
+
+	/* a work procedure may still be queued for the tablet */
+	wcmDeviceLostCancel(common);
+
+	xfree(common->wcmEvents);
+	xfree(common->wcmRecordFile);
+	xfree(common->wcmTraceFile);
+	xfree(common);
+}
+
 /* xf86WcmUninit - called when the device is no longer needed. */
 
 static void xf86WcmUninit(InputDriverPtr drv, LocalDevicePtr local, int flags)
@@ -266,9 +312,21 @@ static void xf86WcmUninit(InputDriverPtr drv, LocalDevicePtr local, int flags)
 		dev = dev->next;
 	}
 
+	/* the last device of the tablet takes the common part along */
+	if (!priv->common->wcmDevices)
+		xf86WcmFreeCommon(priv->common);
+
 	/* free pressure curve */
 	xfree(priv->pPressCurve);
 
+	/* and the rate limit */
+	TimerFree(priv->eventTimer);
+
+#if DEBUG
+	/* the trace may still hold records of it */
+	wcmTraceForget(priv->name);
+#endif
+
 	xfree(priv);
 	local->private = NULL;
 
@@ -302,6 +360,8 @@ static Bool xf86WcmMatchDevice(LocalDevicePtr pMatch, LocalDevicePtr pLocal)
 				privMatch->common->wcmEraserID=pLocal->name;
 			}
 		}
+		xfree(common->wcmRecordFile);
+		xfree(common->wcmTraceFile);
 		xfree(common);
 		common = priv->common = privMatch->common;
 		priv->next = common->wcmDevices;
@@ -322,6 +382,7 @@ static LocalDevicePtr xf86WcmInit(InputDriverPtr drv, IDevPtr dev, int flags)
 	char*		device;
 	static int	numberWacom = 0;
 	int		need_hotplug = 0;
+	int		rc;
 	unsigned long   keys[NBITS(KEY_MAX)];
 
 	gWacomModule.wcmDrv = drv;
@@ -384,9 +445,13 @@ static LocalDevicePtr xf86WcmInit(InputDriverPtr drv, IDevPtr dev, int flags)
 		}
 	}
 
-	/* Process the common options. */
+	/* Process the common options. A reader thread may already read
+	 * the tablet for another of its devices. */
 	xf86ProcessCommonOptions(local, local->options);
-	if (!wcmParseOptions(local, keys))
+	wcmThreadPause(common);
+	rc = wcmParseOptions(local, keys);
+	wcmThreadResume(common);
+	if (!rc)
 		goto SetupProc_fail;
 
 	/* mark the device configured */
@@ -405,7 +470,13 @@ static LocalDevicePtr xf86WcmInit(InputDriverPtr drv, IDevPtr dev, int flags)
 	return (local);
 
 SetupProc_fail:
-	xfree(common);
+	/* a tablet shared with another device keeps its common part */
+	if (common && common->wcmDevices == priv && priv->next)
+		common->wcmDevices = priv->next;
+	else if (common)
+		xf86WcmFreeCommon(common);
+	if (priv)
+		TimerFree(priv->eventTimer);
 	xfree(priv);
 	if (local)
 	{
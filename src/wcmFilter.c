@@ -210,31 +210,80 @@ static void filterLine(int* pCurve, int nMax, int x0, int y0, int x1, int y1)
 
 static void filterIntuosStylus(WacomCommonPtr common, WacomFilterStatePtr state, WacomDeviceStatePtr ds)
 {
-	int x=0, y=0, tx=0, ty=0, i;
+	ds->x = state->sumx / state->size;
+	ds->y = state->sumy / state->size;
 
-	for ( i=0; i<common->wcmRawSample; i++ )
-	{
-		x += state->x[i];
-		y += state->y[i];
-		tx += state->tiltx[i];
-		ty += state->tilty[i];
-	}
-	ds->x = x / common->wcmRawSample;
-	ds->y = y / common->wcmRawSample;
-
-	ds->tiltx = tx / common->wcmRawSample;
+	ds->tiltx = state->sumtiltx / state->size;
 	if (ds->tiltx > common->wcmMaxtiltX/2-1)
    		ds->tiltx = common->wcmMaxtiltX/2-1;	
 	else if (ds->tiltx < -common->wcmMaxtiltX/2)
 		ds->tiltx = -common->wcmMaxtiltX/2;
 
-	ds->tilty = ty / common->wcmRawSample;
+	ds->tilty = state->sumtilty / state->size;
 	if (ds->tilty > common->wcmMaxtiltY/2-1)
    		ds->tilty = common->wcmMaxtiltY/2-1;	
 	else if (ds->tilty < -common->wcmMaxtiltY/2)
 		ds->tilty = -common->wcmMaxtiltY/2;
 }
 
+/*****************************************************************************
+ * wcmFilterInit, wcmFilterAdd --
+ *   The raw filter keeps the last wcmRawSample samples of a channel in
+ *   rings, along with their sums, so adding a sample and averaging them
+ *   costs the same whatever RawSample is. Init fills the rings with one
+ *   sample; Add replaces the oldest, or starts over if RawSample changed.
+ ****************************************************************************/
+
+void wcmFilterInit(WacomCommonPtr common, WacomFilterStatePtr fs,
+	const WacomDeviceState* ds)
+{
+	int i, n = common->wcmRawSample;
+
+	for (i = 0; i < n; i++)
+	{
+		fs->x[i] = ds->x;
+		fs->y[i] = ds->y;
+		fs->tiltx[i] = ds->tiltx;
+		fs->tilty[i] = ds->tilty;
+	}
+	fs->sumx = ds->x * n;
+	fs->sumy = ds->y * n;
+	fs->sumtiltx = ds->tiltx * n;
+	fs->sumtilty = ds->tilty * n;
+	fs->size = n;
+	fs->pos = 0;
+}
+
+void wcmFilterAdd(WacomCommonPtr common, WacomFilterStatePtr fs,
+	const WacomDeviceState* ds, int tilt)
+{
+	int pos;
+
+	if (fs->size != common->wcmRawSample)
+	{
+		wcmFilterInit(common, fs, ds);
+		return;
+	}
+
+	pos = fs->pos + 1;
+	if (pos == fs->size)
+		pos = 0;
+	fs->pos = pos;
+
+	fs->sumx += ds->x - fs->x[pos];
+	fs->sumy += ds->y - fs->y[pos];
+	fs->x[pos] = ds->x;
+	fs->y[pos] = ds->y;
+
+	if (tilt)
+	{
+		fs->sumtiltx += ds->tiltx - fs->tiltx[pos];
+		fs->sumtilty += ds->tilty - fs->tilty[pos];
+		fs->tiltx[pos] = ds->tiltx;
+		fs->tilty[pos] = ds->tilty;
+	}
+}
+
 /*****************************************************************************
  * wcmFilterCoord -- provide noise correction to all transducers
  ****************************************************************************/
@@ -245,24 +294,12 @@ int wcmFilterCoord(WacomCommonPtr common, WacomChannelPtr pChannel,
 	/* Only noise correction should happen here. If there's a problem that
 	 * cannot be fixed, return 1 such that the data is discarded. */
 
-	WacomDeviceState *pLast;
-	int *x, *y, i; 
+	WacomFilterStatePtr fs = &pChannel->rawFilter;
 
 	DBG(10, common, "common->wcmRawSample = %d \n", common->wcmRawSample);
-	x = pChannel->rawFilter.x;
-	y = pChannel->rawFilter.y;
 
-	pLast = &pChannel->valid.state;
-	ds->x = 0;
-	ds->y = 0;
-
-	for ( i=0; i<common->wcmRawSample; i++ )
-	{
-		ds->x += x[i];
-		ds->y += y[i];
-	}
-	ds->x /= common->wcmRawSample;
-	ds->y /= common->wcmRawSample;
+	ds->x = fs->sumx / fs->size;
+	ds->y = fs->sumy / fs->size;
 
 	return 0; /* lookin' good */
 }
@@ -30,6 +30,10 @@ int wcmFilterIntuos(WacomCommonPtr common, WacomChannelPtr pChannel,
 	WacomDeviceStatePtr ds);
 int wcmFilterCoord(WacomCommonPtr common, WacomChannelPtr pChannel,
 	WacomDeviceStatePtr ds);
+void wcmFilterInit(WacomCommonPtr common, WacomFilterStatePtr fs,
+	const WacomDeviceState* ds);
+void wcmFilterAdd(WacomCommonPtr common, WacomFilterStatePtr fs,
+	const WacomDeviceState* ds, int tilt);
 
 /****************************************************************************/
 #endif /* __XF86_WCMFILTER_H */
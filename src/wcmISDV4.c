@@ -34,7 +34,7 @@ static Bool isdv4Init(LocalDevicePtr, char* id, float *version);
 static void isdv4InitISDV4(WacomCommonPtr, const char* id, float version);
 static int isdv4GetRanges(LocalDevicePtr);
 static int isdv4StartTablet(LocalDevicePtr);
-static int isdv4Parse(LocalDevicePtr, const unsigned char* data);
+static int isdv4Parse(LocalDevicePtr, const unsigned char* data, int len);
 static int wcmSerialValidate(WacomCommonPtr common, const unsigned char* data);
 static int wcmWaitForTablet(int fd, char * data, int size);
 static int wcmWriteWait(int fd, const char* request);
@@ -92,9 +92,12 @@ static int wcmSerialValidate(WacomCommonPtr common, const unsigned char* data)
 		{
 			bad = 1;
 			if (i!=0 && (data[i] & HEADER_BIT)) {
-				xf86Msg(X_WARNING, "wcmSerialValidate: "
-					"bad magic at %d v=%x l=%d\n", i,
-					data[i], common->wcmPktLength);
+				if (wcmReaderThread)
+					common->wcmNotes[WCM_NOTE_MAGIC]++;
+				else
+					xf86Msg(X_WARNING, "wcmSerialValidate: "
+						"bad magic at %d v=%x l=%d\n", i,
+						data[i], common->wcmPktLength);
 				return i;
 			}
 		}
@@ -137,6 +140,9 @@ static Bool isdv4Init(LocalDevicePtr local, char* id, float *version)
 	/*set the model */
 	common->wcmModel = &isdv4General;
 
+	/* serial data trickles in, a small reception buffer will do */
+	wcmRingInit(&common->wcmRing, common->buffer, ISDV4_BUFFER_SIZE);
+
 	return Success;
 }
 
@@ -392,7 +398,7 @@ static int isdv4StartTablet(LocalDevicePtr local)
 	return Success;
 }
 
-static int isdv4Parse(LocalDevicePtr local, const unsigned char* data)
+static int isdv4Parse(LocalDevicePtr local, const unsigned char* data, int len)
 {
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
 	WacomCommonPtr common = priv->common;
@@ -403,6 +409,27 @@ static int isdv4Parse(LocalDevicePtr local, const unsigned char* data)
 
 	DBG(10, common, "\n");
 
+	/* pen and touch packets differ in length, choose wcmPktLength
+	 * if it is not an out-prox event */
+	if (data[0])
+		common->wcmPktLength = WACOM_PKGLEN_TPCPEN;
+
+	if (data[0] & 0x10)
+	{
+		/* set touch PktLength */
+		common->wcmPktLength = WACOM_PKGLEN_TOUCH93;
+		if ((common->tablet_id == 0x9A) || (common->tablet_id == 0x9F))
+			common->wcmPktLength = WACOM_PKGLEN_TOUCH9A;
+		if ((common->tablet_id == 0xE2) || (common->tablet_id == 0xE3))
+			common->wcmPktLength = WACOM_PKGLEN_TOUCH2FG;
+	}
+
+	if (len < common->wcmPktLength)
+	{
+		/* we can't handle this yet */
+		return 0;
+	}
+
 	/* determine the type of message (touch or stylus) */
 	if (data[0] & 0x10) /* a touch data */
 	{
@@ -425,12 +452,6 @@ static int isdv4Parse(LocalDevicePtr local, const unsigned char* data)
 		}
 	}
 
-	if (common->buffer + common->bufpos - data < common->wcmPktLength)
-	{
-		/* we can't handle this yet */
-		return common->wcmPktLength;
-	}
-
 	/* Coordinate data bit check */
 	if (data[0] & 0x40) /* control data */
 		return common->wcmPktLength;
@@ -440,6 +461,7 @@ static int isdv4Parse(LocalDevicePtr local, const unsigned char* data)
 	/* pick up where we left off, minus relative values */
 	ds = &common->wcmChannel[channel].work;
 	RESET_RELATIVE(*ds);
+	ds->time_us = common->wcmRecvTime;
 
 	if (common->wcmPktLength != WACOM_PKGLEN_TPCPEN) /* a touch */
 	{
@@ -452,6 +474,10 @@ static int isdv4Parse(LocalDevicePtr local, const unsigned char* data)
 		ds->buttons = ds->proximity = data[0] & 0x01;
 		ds->device_type = TOUCH_ID;
 		ds->device_id = TOUCH_DEVICE_ID;
+		ds->changed = WCM_CHANGED_X | WCM_CHANGED_Y |
+			WCM_CHANGED_BUTTONS | WCM_CHANGED_TOOL;
+		if (common->wcmPktLength == WACOM_PKGLEN_TOUCH9A)
+			ds->changed |= WCM_CHANGED_CAPACITY;
 
 		if (common->wcmPktLength == WACOM_PKGLEN_TOUCH2FG)
 		{
@@ -461,26 +487,19 @@ static int isdv4Parse(LocalDevicePtr local, const unsigned char* data)
 				/* Got 2FGT. Send the first one if received */
 				if (ds->proximity || (!ds->proximity &&
 						 last->proximity))
-				{
-					/* time stamp for 2FGT gesture events */
-					if ((ds->proximity && !last->proximity) ||
-						    (!ds->proximity && last->proximity))
-						ds->sample = (int)GetTimeInMillis();
 					wcmEvent(common, channel, ds);
-				}
 
 				channel = 1;
 				ds = &common->wcmChannel[channel].work;
 				RESET_RELATIVE(*ds);
+				ds->time_us = common->wcmRecvTime;
 				ds->x = (((int)data[7]) << 7) | ((int)data[8]);
 				ds->y = (((int)data[9]) << 7) | ((int)data[10]);
 				ds->device_type = TOUCH_ID;
 				ds->device_id = TOUCH_DEVICE_ID;
 				ds->proximity = data[0] & 0x02;
-				/* time stamp for 2FGT gesture events */
-				if ((ds->proximity && !lastTemp->proximity) ||
-					    (!ds->proximity && lastTemp->proximity))
-					ds->sample = (int)GetTimeInMillis();
+				ds->changed = WCM_CHANGED_X | WCM_CHANGED_Y |
+					WCM_CHANGED_TOOL;
 			}
 		}
 
@@ -536,6 +555,11 @@ static int isdv4Parse(LocalDevicePtr local, const unsigned char* data)
 			ds->device_id = ERASER_DEVICE_ID;
 		}
 
+		/* pen packets carry no tilt, wheel or strip data */
+		ds->changed = WCM_CHANGED_X | WCM_CHANGED_Y |
+			WCM_CHANGED_PRESSURE | WCM_CHANGED_BUTTONS |
+			WCM_CHANGED_TOOL;
+
 		DBG(8, priv, "%s\n",
 			ds->device_type == ERASER_ID ? "ERASER " :
 			ds->device_type == STYLUS_ID ? "STYLUS" : "NONE");
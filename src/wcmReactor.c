@@ -0,0 +1,233 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xf86Wacom.h"
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+/*****************************************************************************
+ * Shared reader
+ *
+ * All tablets using it are in one epoll set, which is the only descriptor
+ * the server watches for them. On a wakeup every ready tablet is read in
+ * turns, one read each per round, until it runs dry or its read budget is
+ * used up; a busy tablet can't keep the others waiting.
+ ****************************************************************************/
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#define REACTOR_MAX_READY 16    /* tablets taken per epoll_wait */
+
+static int reactorFd = -1;      /* the epoll set */
+static pointer reactorHandler;  /* its X input handler */
+static int reactorTablets;      /* tablets in the set */
+
+/*****************************************************************************
+ * wcmReactorClose --
+ *   Close the epoll set once no tablet is left in it.
+ ****************************************************************************/
+
+static void wcmReactorClose(void)
+{
+	xf86RemoveInputHandler(reactorHandler);
+	close(reactorFd);
+	reactorFd = -1;
+}
+
+/*****************************************************************************
+ * wcmReactorIdle --
+ *   The last tablet was dropped by wcmReactorInput, which can't remove its
+ *   own input handler. Close the set unless a tablet was added since.
+ ****************************************************************************/
+
+static Bool wcmReactorIdle(ClientPtr client, pointer data)
+{
+	if (!reactorTablets && reactorFd >= 0)
+		wcmReactorClose();
+	return TRUE;
+}
+
+/*****************************************************************************
+ * wcmReactorDrop --
+ *   Take the tablet out of the set.
+ ****************************************************************************/
+
+static void wcmReactorDrop(WacomCommonPtr common)
+{
+	epoll_ctl(reactorFd, EPOLL_CTL_DEL, common->fd, NULL);
+	common->wcmReactorLocal = NULL;
+	reactorTablets--;
+}
+
+/*****************************************************************************
+ * wcmReactorInput --
+ *   Read all ready tablets, round robin.
+ ****************************************************************************/
+
+static void wcmReactorInput(int fd, pointer data)
+{
+	struct epoll_event events[REACTOR_MAX_READY];
+	WacomCommonPtr ready[REACTOR_MAX_READY];
+	int reads[REACTOR_MAX_READY];
+	WacomCommonPtr common;
+	LocalDevicePtr local;
+	int i, n, pending, len;
+
+	n = epoll_wait(fd, events, REACTOR_MAX_READY, 0);
+	for (i = 0; i < n; i++)
+	{
+		ready[i] = events[i].data.ptr;
+		reads[i] = 0;
+	}
+
+	for (pending = n; pending; )
+	{
+		for (i = 0; i < n; i++)
+		{
+			common = ready[i];
+			if (!common)
+				continue;
+
+			local = common->wcmReactorLocal;
+			len = local ? common->wcmDevCls->Read(local) : 0;
+			if (len < 0)
+			{
+				xf86Msg(X_ERROR, "%s: Error reading wacom device : %s\n",
+					local->name, strerror(errno));
+				/* stop the wakeups until the devices are off */
+				wcmReactorDrop(common);
+				if (!reactorTablets)
+					QueueWorkProc(wcmReactorIdle, NULL, NULL);
+				wcmDeviceLostLater(common);
+			}
+			else if (len && ++reads[i] < common->wcmReadBudget)
+				continue;
+			else if (len)
+			{
+				common->wcmReadBudgetHits++;
+				DBG(1, common, "Can't keep up!!! (%u wakeups over budget)\n",
+					common->wcmReadBudgetHits);
+			}
+
+			/* this one is done for now */
+			wcmFlushCoalesced(common);
+			ready[i] = NULL;
+			pending--;
+		}
+	}
+}
+
+/*****************************************************************************
+ * wcmReactorAdd --
+ *   Have the shared reader read the tablet of this device, unless it
+ *   already does. Returns !Success if the caller has to read it itself.
+ ****************************************************************************/
+
+int wcmReactorAdd(LocalDevicePtr local)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	struct epoll_event event;
+
+	if (common->wcmReactorLocal)
+		return Success;
+
+	if (reactorFd < 0)
+	{
+		reactorFd = epoll_create(REACTOR_MAX_READY);
+		if (reactorFd < 0)
+			goto fail;
+		reactorHandler = xf86AddInputHandler(reactorFd,
+			wcmReactorInput, NULL);
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = common;
+	if (epoll_ctl(reactorFd, EPOLL_CTL_ADD, common->fd, &event))
+		goto fail;
+
+	common->wcmReactorLocal = local;
+	reactorTablets++;
+	DBG(1, common, "%s read by the shared reader, %d tablets\n",
+		common->wcmDevice, reactorTablets);
+	return Success;
+
+fail:
+	xf86Msg(X_ERROR, "%s: unable to use the shared reader: %s\n",
+		local->name, strerror(errno));
+	common->wcmShared = 0;
+	if (!reactorTablets && reactorFd >= 0)
+		wcmReactorClose();
+	return !Success;
+}
+
+/*****************************************************************************
+ * wcmReactorRemove --
+ *   This device is being turned off. If the shared reader reads on its
+ *   behalf, hand the tablet over to another of its devices that is still
+ *   on, or take it out of the set.
+ ****************************************************************************/
+
+void wcmReactorRemove(LocalDevicePtr local)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	WacomDevicePtr wDev;
+
+	if (common->wcmReactorLocal != local)
+		return;
+
+	for (wDev = common->wcmDevices; wDev; wDev = wDev->next)
+	{
+		if (wDev->local != local && wDev->local->fd >= 0 &&
+				wDev->local->dev && wDev->local->dev->public.on)
+		{
+			common->wcmReactorLocal = wDev->local;
+			return;
+		}
+	}
+
+	wcmReactorDrop(common);
+	if (!reactorTablets)
+		wcmReactorClose();
+}
+
+#else /* !HAVE_SYS_EPOLL_H */
+
+int wcmReactorAdd(LocalDevicePtr local)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+
+	xf86Msg(X_WARNING, "%s: no shared reader on this system\n",
+		local->name);
+	priv->common->wcmShared = 0;
+	return !Success;
+}
+
+void wcmReactorRemove(LocalDevicePtr local)
+{
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+/* vim: set noexpandtab shiftwidth=8: */
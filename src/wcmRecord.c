@@ -0,0 +1,333 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xf86Wacom.h"
+#include "wacom-record.h"
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+
+/*****************************************************************************
+ * Recorder
+ *
+ * wcmReadPacket copies every chunk it reads into a byte ring, which is all
+ * the reading side does. A thread of the recorder writes the ring out to
+ * the file whenever enough piled up, or every RECORD_FLUSH_MS. Chunks that
+ * find the ring full are dropped and counted, reading never waits for the
+ * disk. See include/wacom-record.h for the file format.
+ ****************************************************************************/
+
+#define RECORD_RING_SIZE  (1 << 20) /* bytes, a power of two */
+#define RECORD_WAKE_SIZE  (1 << 16) /* pending bytes that wake the writer */
+#define RECORD_FLUSH_MS   500       /* writer interval otherwise */
+
+struct _WacomRecorder
+{
+	pthread_t thread;
+	int fd;                 /* the record file */
+	int wakeup[2];          /* reader writes, writer thread reads */
+	volatile int running;   /* cleared to stop the writer */
+	unsigned int woken;     /* head when the writer was last woken */
+	unsigned int dropped;   /* chunks that didn't fit */
+	unsigned int failed;    /* writes to the file that failed */
+
+	/* only the reader writes head, only the writer writes tail */
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	unsigned char ring[RECORD_RING_SIZE];
+};
+
+/*****************************************************************************
+ * wcmRecordPut --
+ *   Append a chunk to the ring, if there is room for it.
+ ****************************************************************************/
+
+static void wcmRecordPut(WacomRecorderPtr rec, int64_t time_us, int type,
+	const void* data, int len)
+{
+	WacomRecordChunk chunk;
+	unsigned int head = rec->head;
+	unsigned int i, n;
+	const unsigned char* src;
+
+	if (RECORD_RING_SIZE - (head - rec->tail) < sizeof(chunk) + len)
+	{
+		rec->dropped++;
+		return;
+	}
+
+	chunk.time_us = time_us;
+	chunk.type = type;
+	chunk.len = len;
+
+	for (i = 0; i < 2; i++)
+	{
+		src = i ? data : (const void*)&chunk;
+		n = i ? len : sizeof(chunk);
+		while (n)
+		{
+			unsigned int pos = head & (RECORD_RING_SIZE - 1);
+			unsigned int cnt = RECORD_RING_SIZE - pos;
+
+			if (cnt > n)
+				cnt = n;
+			memcpy(rec->ring + pos, src, cnt);
+			src += cnt;
+			head += cnt;
+			n -= cnt;
+		}
+	}
+
+	/* publish the bytes before the new head */
+	__sync_synchronize();
+	rec->head = head;
+
+	if (head - rec->woken >= RECORD_WAKE_SIZE)
+	{
+		/* a full pipe already wakes it; on failure retry later */
+		rec->woken = head;
+		if (write(rec->wakeup[1], "", 1) < 0 && errno != EAGAIN)
+			rec->woken = rec->tail;
+	}
+}
+
+/*****************************************************************************
+ * wcmRecordMain --
+ *   Writer thread: move the ring to the file until stopped, then once more.
+ ****************************************************************************/
+
+static void* wcmRecordMain(void* data)
+{
+	WacomRecorderPtr rec = data;
+	struct pollfd pfd;
+	unsigned int tail, head, pos, cnt;
+	char buf[64];
+	int done = 0, len;
+
+	pfd.fd = rec->wakeup[0];
+	pfd.events = POLLIN;
+
+	while (!done)
+	{
+		done = !rec->running;
+		if (!done && poll(&pfd, 1, RECORD_FLUSH_MS) > 0)
+			while (read(rec->wakeup[0], buf, sizeof(buf)) > 0)
+				;
+
+		head = rec->head;
+		/* read the bytes only after seeing the head */
+		__sync_synchronize();
+		for (tail = rec->tail; tail != head; tail += cnt)
+		{
+			pos = tail & (RECORD_RING_SIZE - 1);
+			cnt = RECORD_RING_SIZE - pos;
+			if (cnt > head - tail)
+				cnt = head - tail;
+			len = write(rec->fd, rec->ring + pos, cnt);
+			if (len < 0 && errno == EINTR)
+			{
+				cnt = 0;
+				continue;
+			}
+			if (len <= 0)
+			{
+				/* disk full or so; keep draining, count the loss */
+				rec->failed++;
+				len = cnt;
+			}
+			cnt = len;
+		}
+
+		/* hand the space back only when done with it */
+		__sync_synchronize();
+		rec->tail = tail;
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************
+ * wcmRecordHeader --
+ *   Fill in what the tablet was opened as.
+ ****************************************************************************/
+
+static void wcmRecordHeader(WacomCommonPtr common, WacomRecordHeader* hdr)
+{
+	struct input_id id;
+	struct input_absinfo absinfo;
+	int i;
+
+	memset(hdr, 0, sizeof(*hdr));
+	strncpy(hdr->magic, WACOM_RECORD_MAGIC, sizeof(hdr->magic));
+	hdr->version = WACOM_RECORD_VERSION;
+	hdr->size = sizeof(*hdr);
+
+	hdr->device_class = (common->wcmDevCls == &gWacomUSBDevice) ?
+		WACOM_RECORD_USB : WACOM_RECORD_ISDV4;
+	hdr->tablet_id = common->tablet_id;
+	hdr->protocol_level = common->wcmProtocolLevel;
+	hdr->pkt_length = common->wcmPktLength;
+	hdr->flags = common->wcmFlags;
+	if (common->wcmModel)
+		strncpy(hdr->model, common->wcmModel->name,
+			sizeof(hdr->model) - 1);
+
+	hdr->max_x = common->wcmMaxX;
+	hdr->max_y = common->wcmMaxY;
+	hdr->max_z = common->wcmMaxZ;
+	hdr->max_touch_x = common->wcmMaxTouchX;
+	hdr->max_touch_y = common->wcmMaxTouchY;
+	hdr->max_capacity = common->wcmMaxCapacity;
+	hdr->max_dist = common->wcmMaxDist;
+	hdr->max_tilt_x = common->wcmMaxtiltX;
+	hdr->max_tilt_y = common->wcmMaxtiltY;
+	hdr->max_strip_x = common->wcmMaxStripX;
+	hdr->max_strip_y = common->wcmMaxStripY;
+	hdr->resol_x = common->wcmResolX;
+	hdr->resol_y = common->wcmResolY;
+	hdr->touch_resol_x = common->wcmTouchResolX;
+	hdr->touch_resol_y = common->wcmTouchResolY;
+
+	if (hdr->device_class != WACOM_RECORD_USB)
+		return;
+
+	if (ioctl(common->fd, EVIOCGID, &id) == 0)
+	{
+		hdr->vendor = id.vendor;
+		hdr->product = id.product;
+	}
+	ioctl(common->fd, EVIOCGBIT(EV_KEY, sizeof(hdr->key_bits)),
+		hdr->key_bits);
+	ioctl(common->fd, EVIOCGBIT(EV_ABS, sizeof(hdr->abs_bits)),
+		hdr->abs_bits);
+	for (i = 0; i < WACOM_RECORD_ABS_AXES; i++)
+	{
+		if (!(hdr->abs_bits[i / 8] & (1 << (i % 8))) ||
+				ioctl(common->fd, EVIOCGABS(i), &absinfo) < 0)
+			continue;
+		hdr->abs_min[i] = absinfo.minimum;
+		hdr->abs_max[i] = absinfo.maximum;
+	}
+}
+
+/*****************************************************************************
+ * wcmRecordStart --
+ *   The tablet was just opened; start recording it. The file is appended
+ *   to, every open adds a header.
+ ****************************************************************************/
+
+void wcmRecordStart(LocalDevicePtr local)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	WacomRecorderPtr rec = common->wcmRecorder;
+	WacomRecordHeader hdr;
+	int i;
+
+	if (!rec)
+	{
+		rec = xcalloc(1, sizeof(WacomRecorder));
+		if (!rec)
+			goto fail;
+
+		rec->fd = open(common->wcmRecordFile,
+			O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (rec->fd < 0)
+		{
+			xfree(rec);
+			goto fail;
+		}
+
+		if (pipe(rec->wakeup))
+		{
+			close(rec->fd);
+			xfree(rec);
+			goto fail;
+		}
+		for (i = 0; i < 2; i++)
+			fcntl(rec->wakeup[i], F_SETFL,
+				fcntl(rec->wakeup[i], F_GETFL) | O_NONBLOCK);
+
+		rec->running = 1;
+		if (pthread_create(&rec->thread, NULL, wcmRecordMain, rec))
+		{
+			close(rec->wakeup[0]);
+			close(rec->wakeup[1]);
+			close(rec->fd);
+			xfree(rec);
+			goto fail;
+		}
+		common->wcmRecorder = rec;
+		xf86Msg(X_INFO, "%s: recording %s to %s\n", local->name,
+			common->wcmDevice, common->wcmRecordFile);
+	}
+
+	wcmRecordHeader(common, &hdr);
+	wcmRecordPut(rec, wcmGetTimeInMicros(), WACOM_RECORD_OPEN,
+		&hdr, sizeof(hdr));
+	return;
+
+fail:
+	xf86Msg(X_ERROR, "%s: unable to record to %s: %s\n", local->name,
+		common->wcmRecordFile, strerror(errno));
+	xfree(common->wcmRecordFile);
+	common->wcmRecordFile = NULL;
+}
+
+/*****************************************************************************
+ * wcmRecordData --
+ *   Record what one read of the device returned.
+ ****************************************************************************/
+
+void wcmRecordData(WacomCommonPtr common, const unsigned char* data, int len)
+{
+	wcmRecordPut(common->wcmRecorder, common->wcmRecvTime,
+		WACOM_RECORD_DATA, data, len);
+}
+
+/*****************************************************************************
+ * wcmRecordStop --
+ *   The tablet is being closed; write out what's left and close the file.
+ ****************************************************************************/
+
+void wcmRecordStop(WacomCommonPtr common)
+{
+	WacomRecorderPtr rec = common->wcmRecorder;
+
+	if (!rec)
+		return;
+
+	rec->running = 0;
+	if (write(rec->wakeup[1], "", 1) < 0 && errno != EAGAIN)
+		DBG(1, common, "recorder wakeup failed: %s\n", strerror(errno));
+	pthread_join(rec->thread, NULL);
+
+	if (rec->dropped || rec->failed)
+		xf86Msg(X_WARNING, "%s: recording dropped %u chunks, "
+			"%u writes failed\n", common->wcmDevice,
+			rec->dropped, rec->failed);
+
+	close(rec->wakeup[0]);
+	close(rec->wakeup[1]);
+	close(rec->fd);
+	common->wcmRecorder = NULL;
+	xfree(rec);
+}
+/* vim: set noexpandtab shiftwidth=8: */
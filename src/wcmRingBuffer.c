@@ -0,0 +1,117 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software 
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include "wcmRingBuffer.h"
+
+/*****************************************************************************
+ * wcmRingInit --
+ *   Set up an empty ring on top of size + RING_MIRROR_SIZE bytes of data.
+ ****************************************************************************/
+
+void wcmRingInit(WacomRingPtr ring, unsigned char* data, int size)
+{
+	ring->data = data;
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->count = 0;
+}
+
+/*****************************************************************************
+ * wcmRingWriteSpace --
+ *   Return where the next read goes and how much fits there.
+ ****************************************************************************/
+
+unsigned char* wcmRingWriteSpace(WacomRingPtr ring, int* len)
+{
+	if (ring->count == ring->size)
+		*len = 0;
+	else if (ring->head >= ring->tail)
+		*len = ring->size - ring->head;
+	else
+		*len = ring->tail - ring->head;
+
+	return ring->data + ring->head;
+}
+
+/*****************************************************************************
+ * wcmRingCommit --
+ *   Account for len bytes read into the write space.
+ ****************************************************************************/
+
+void wcmRingCommit(WacomRingPtr ring, int len)
+{
+	/* refresh the mirror if the data landed at the start of the ring */
+	if (ring->head < RING_MIRROR_SIZE)
+	{
+		int n = RING_MIRROR_SIZE - ring->head;
+		if (n > len)
+			n = len;
+		memcpy(ring->data + ring->size + ring->head,
+			ring->data + ring->head, n);
+	}
+
+	ring->head += len;
+	if (ring->head == ring->size)
+		ring->head = 0;
+	ring->count += len;
+}
+
+/*****************************************************************************
+ * wcmRingAvailable --
+ ****************************************************************************/
+
+int wcmRingAvailable(const WacomRing* ring)
+{
+	return ring->count;
+}
+
+/*****************************************************************************
+ * wcmRingPeek --
+ *   Return the unparsed data as one contiguous block.
+ ****************************************************************************/
+
+const unsigned char* wcmRingPeek(const WacomRing* ring, int* len)
+{
+	int n = ring->size + RING_MIRROR_SIZE - ring->tail;
+
+	*len = (ring->count < n) ? ring->count : n;
+	return ring->data + ring->tail;
+}
+
+/*****************************************************************************
+ * wcmRingConsume --
+ *   Drop len parsed bytes from the tail.
+ ****************************************************************************/
+
+void wcmRingConsume(WacomRingPtr ring, int len)
+{
+	ring->count -= len;
+
+	/* start over at the front once empty, so the next read gets
+	 * the whole ring in one piece */
+	if (!ring->count)
+		ring->head = ring->tail = 0;
+	else
+		ring->tail = (ring->tail + len) % ring->size;
+}
+
+/* vim: set noexpandtab shiftwidth=8: */
@@ -0,0 +1,61 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software 
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __XF86_WCMRINGBUFFER_H
+#define __XF86_WCMRINGBUFFER_H
+
+/*****************************************************************************
+ * WacomRing - reception ring buffer
+ *
+ * Data is read straight into the ring and handed to the parsers as a
+ * contiguous view, so nothing ever has to be moved around. The first
+ * RING_MIRROR_SIZE bytes of the ring are mirrored past its end: a packet
+ * wrapping around the end can still be looked at in one piece.
+ *
+ * The ring doesn't depend on the X server; it only manages the storage
+ * handed to wcmRingInit, which must be size + RING_MIRROR_SIZE bytes.
+ ****************************************************************************/
+
+#define RING_MIRROR_SIZE 32     /* >= largest packet parsed in one piece */
+
+typedef struct _WacomRing WacomRing, *WacomRingPtr;
+
+struct _WacomRing
+{
+	unsigned char* data;    /* storage, size + RING_MIRROR_SIZE bytes */
+	int size;               /* ring size */
+	int head;               /* offset where the next read goes */
+	int tail;               /* offset of the first unparsed byte */
+	int count;              /* number of unparsed bytes */
+};
+
+void wcmRingInit(WacomRingPtr ring, unsigned char* data, int size);
+
+/* contiguous free space at the head: read up to *len bytes there, then
+ * account for them with wcmRingCommit */
+unsigned char* wcmRingWriteSpace(WacomRingPtr ring, int* len);
+void wcmRingCommit(WacomRingPtr ring, int len);
+
+/* number of unparsed bytes */
+int wcmRingAvailable(const WacomRing* ring);
+
+/* contiguous view of the unparsed bytes; *len may be less than
+ * wcmRingAvailable only when more than RING_MIRROR_SIZE bytes wrap */
+const unsigned char* wcmRingPeek(const WacomRing* ring, int* len);
+void wcmRingConsume(WacomRingPtr ring, int len);
+
+/****************************************************************************/
+#endif /* __XF86_WCMRINGBUFFER_H */
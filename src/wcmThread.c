@@ -0,0 +1,441 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xf86Wacom.h"
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+
+/*****************************************************************************
+ * Threaded mode
+ *
+ * The reader thread reads, parses and filters everything the tablet
+ * sends. The states wcmEvent would dispatch are queued instead, in a
+ * single producer, single consumer ring. The X server is woken up through
+ * a pipe and only dispatches the queued states. Gestures look at the
+ * channel history while posting events, so they need the unthreaded path.
+ *
+ * The thread holds its lock while it reads. Property handlers, and the
+ * options of devices added to the tablet later, change settings it uses
+ * (wcmSuppress, wcmRawSample, wcmThreshold, wcmTouch, wcmRotate and the
+ * like) only with the thread paused, see wcmThreadPause. Nor does the
+ * thread write the server log: DBG() only
+ * records in the trace ring there, and what it would have logged
+ * otherwise is counted in wcmNotes and logged by wcmThreadInput.
+ ****************************************************************************/
+
+#define THREAD_QUEUE_SIZE 512   /* queued states, a power of two */
+#define THREAD_READ_ROOM  128   /* states one read may produce at most */
+#define THREAD_POLL_MS    100   /* how often the thread checks for a stop */
+#define THREAD_WAIT_MS    5     /* retry interval while the queue is full */
+
+__thread int wcmReaderThread;
+
+/* wcmNotes as logged, see WCM_NOTE_* */
+static const char* wcmNoteText[WCM_NOTES] =
+{
+	"usbParse: Exceeded event queue",
+	"usbParse: Ignoring event from invalid serial 0",
+	"rel event recv'd",
+	"Got unexpected SYN_REPORT, changing mode",
+	"unable to resync key state",
+	"wcmSerialValidate: bad magic",
+};
+
+typedef struct
+{
+	unsigned int channel;
+	int suppress;
+	WacomDeviceState state;
+} WacomQueuedState;
+
+struct _WacomThread
+{
+	pthread_t thread;
+	pthread_mutex_t lock;   /* held by the thread while it reads */
+	int paused;             /* the X server holds the lock, nesting */
+	LocalDevicePtr local;   /* the device the thread reads for */
+	pointer handler;        /* X input handler of the wakeup pipe */
+	int wakeup[2];          /* thread writes, X server reads */
+	volatile int running;   /* cleared to stop the thread */
+	volatile int lost;      /* set when the device went away */
+	int error;              /* errno of the failed read */
+	unsigned int logged[WCM_NOTES]; /* wcmNotes logged so far */
+
+	/* only the thread writes head, only the X server writes tail */
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	WacomQueuedState queue[THREAD_QUEUE_SIZE];
+};
+
+/*****************************************************************************
+ * wcmThreadQueue --
+ *   Queue a state for the X server; called by wcmEvent in the thread.
+ ****************************************************************************/
+
+void wcmThreadQueue(WacomCommonPtr common, unsigned int channel,
+	const WacomDeviceState* ds, int suppress)
+{
+	WacomThreadPtr thread = common->wcmThread;
+	WacomQueuedState* q;
+	unsigned int head = thread->head;
+
+	/* the thread leaves room for a whole read, this can't happen */
+	if (head - thread->tail >= THREAD_QUEUE_SIZE)
+	{
+		common->wcmQueueOverflows++;
+		return;
+	}
+
+	q = &thread->queue[head & (THREAD_QUEUE_SIZE - 1)];
+	q->channel = channel;
+	q->suppress = suppress;
+	q->state = *ds;
+
+	/* publish the state before the new head */
+	__sync_synchronize();
+	thread->head = head + 1;
+}
+
+/*****************************************************************************
+ * wcmThreadMain --
+ *   Keep the device drained for as long as the thread runs.
+ ****************************************************************************/
+
+static void* wcmThreadMain(void* data)
+{
+	WacomThreadPtr thread = data;
+	LocalDevicePtr local = thread->local;
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	struct pollfd pfd;
+	unsigned int head;
+	int loop, len = 0;
+
+	wcmReaderThread = 1;
+	pfd.fd = common->fd;
+	pfd.events = POLLIN;
+
+	while (thread->running)
+	{
+		/* don't read what there is no room for, the kernel
+		 * buffers it meanwhile */
+		if (thread->head - thread->tail > THREAD_QUEUE_SIZE - THREAD_READ_ROOM)
+		{
+			common->wcmQueueStalls++;
+			poll(NULL, 0, THREAD_WAIT_MS);
+			continue;
+		}
+
+		if (poll(&pfd, 1, THREAD_POLL_MS) <= 0)
+			continue;
+
+		pthread_mutex_lock(&thread->lock);
+		if (!thread->running)
+		{
+			pthread_mutex_unlock(&thread->lock);
+			break;
+		}
+
+		head = thread->head;
+		for (loop = 0; loop < common->wcmReadBudget; ++loop)
+		{
+			if (thread->head - thread->tail > THREAD_QUEUE_SIZE - THREAD_READ_ROOM)
+				break;
+			len = common->wcmDevCls->Read(local);
+			if (len <= 0)
+				break;
+		}
+		wcmFlushCoalesced(common);
+		pthread_mutex_unlock(&thread->lock);
+
+		if (len < 0)
+		{
+			thread->error = errno;
+			thread->lost = 1;
+			thread->running = 0;
+		}
+
+		/* wake the X server up, a full pipe already does */
+		if (thread->head != head || thread->lost)
+			if (write(thread->wakeup[1], "", 1) < 0 && errno != EAGAIN)
+				DBG(1, common, "wakeup failed: %s\n", strerror(errno));
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************
+ * wcmThreadNotes --
+ *   Log what the thread ran into since the last time.
+ ****************************************************************************/
+
+static void wcmThreadNotes(WacomCommonPtr common, WacomThreadPtr thread)
+{
+	unsigned int n;
+	int i;
+
+	for (i = 0; i < WCM_NOTES; i++)
+	{
+		n = common->wcmNotes[i] - thread->logged[i];
+		if (!n)
+			continue;
+		thread->logged[i] += n;
+		xf86Msg(X_ERROR, "%s: %s (%u times)\n",
+			thread->local->name, wcmNoteText[i], n);
+	}
+}
+
+/*****************************************************************************
+ * wcmThreadInput --
+ *   X server side: dispatch the states the thread queued.
+ ****************************************************************************/
+
+static void wcmThreadInput(int fd, pointer data)
+{
+	WacomCommonPtr common = data;
+	WacomThreadPtr thread = common->wcmThread;
+	WacomQueuedState* q;
+	unsigned int tail = thread->tail;
+	char buf[64];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	while (tail != thread->head)
+	{
+		/* read the state only after seeing the head */
+		__sync_synchronize();
+		q = &thread->queue[tail & (THREAD_QUEUE_SIZE - 1)];
+		commonDispatchDevice(common, q->channel, &q->state, q->suppress);
+
+		/* hand the slot back only when done with it */
+		__sync_synchronize();
+		thread->tail = ++tail;
+	}
+
+	wcmThreadNotes(common, thread);
+
+	if (thread->lost)
+	{
+		thread->lost = 0;
+		xf86Msg(X_ERROR, "%s: Error reading wacom device : %s\n",
+			thread->local->name, strerror(thread->error));
+		/* the input handler can't remove itself */
+		wcmDeviceLostLater(common);
+	}
+}
+
+/*****************************************************************************
+ * wcmThreadFallback --
+ *   There is no thread for the tablet anymore. Have its devices that are
+ *   still on read it the way DEVICE_ON does without one.
+ ****************************************************************************/
+
+static void wcmThreadFallback(WacomCommonPtr common, LocalDevicePtr off)
+{
+	WacomDevicePtr wDev;
+	LocalDevicePtr local;
+
+	for (wDev = common->wcmDevices; wDev; wDev = wDev->next)
+	{
+		local = wDev->local;
+		if (local == off || local->fd < 0 || !local->dev ||
+				!local->dev->public.on)
+			continue;
+
+		if (!common->wcmShared || wcmReactorAdd(local) != Success)
+			xf86AddEnabledDevice(local);
+	}
+}
+
+/*****************************************************************************
+ * wcmThreadStart --
+ *   Start reading the device in a thread of its own, unless it already
+ *   is. Returns !Success if the caller has to read the device itself.
+ ****************************************************************************/
+
+int wcmThreadStart(LocalDevicePtr local)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	WacomThreadPtr thread;
+	int i;
+
+	if (common->wcmThread)
+		return Success;
+
+	if (common->wcmTouch && common->wcmGesture)
+	{
+		xf86Msg(X_WARNING, "%s: touch gestures need the device "
+			"read in the server, not using a thread\n", local->name);
+		common->wcmThreaded = 0;
+		return !Success;
+	}
+
+	thread = xcalloc(1, sizeof(WacomThread));
+	if (!thread)
+		goto fail;
+
+	if (pipe(thread->wakeup))
+	{
+		xfree(thread);
+		goto fail;
+	}
+	for (i = 0; i < 2; i++)
+		fcntl(thread->wakeup[i], F_SETFL,
+			fcntl(thread->wakeup[i], F_GETFL) | O_NONBLOCK);
+
+	thread->local = local;
+	thread->running = 1;
+	pthread_mutex_init(&thread->lock, NULL);
+	memcpy(thread->logged, common->wcmNotes, sizeof(thread->logged));
+	common->wcmThread = thread;
+
+	if (pthread_create(&thread->thread, NULL, wcmThreadMain, thread))
+	{
+		common->wcmThread = NULL;
+		pthread_mutex_destroy(&thread->lock);
+		close(thread->wakeup[0]);
+		close(thread->wakeup[1]);
+		xfree(thread);
+		goto fail;
+	}
+
+	thread->handler = xf86AddInputHandler(thread->wakeup[0],
+		wcmThreadInput, common);
+
+	DBG(1, common, "reading %s in a thread\n", common->wcmDevice);
+	return Success;
+
+fail:
+	xf86Msg(X_ERROR, "%s: unable to start the reader thread: %s\n",
+		local->name, strerror(errno));
+	common->wcmThreaded = 0;
+	return !Success;
+}
+
+/*****************************************************************************
+ * wcmThreadEnd --
+ *   Stop the thread and free it, paused or not. The states it still
+ *   queued are dispatched if dispatch is set, dropped otherwise.
+ ****************************************************************************/
+
+static void wcmThreadEnd(WacomCommonPtr common, Bool dispatch)
+{
+	WacomThreadPtr thread = common->wcmThread;
+
+	thread->running = 0;
+	if (thread->paused)
+		pthread_mutex_unlock(&thread->lock);
+	pthread_join(thread->thread, NULL);
+
+	if (dispatch)
+		wcmThreadInput(thread->wakeup[0], common);
+	else
+		wcmThreadNotes(common, thread);
+
+	xf86RemoveInputHandler(thread->handler);
+	pthread_mutex_destroy(&thread->lock);
+	close(thread->wakeup[0]);
+	close(thread->wakeup[1]);
+	common->wcmThread = NULL;
+	xfree(thread);
+
+	DBG(1, common, "reader thread stopped\n");
+}
+
+/*****************************************************************************
+ * wcmThreadStop --
+ *   Stop the thread if it reads for this device, which is being turned
+ *   off, and hand it over to another device of the tablet that is still
+ *   on. If the thread can't be started again, the devices still on read
+ *   the tablet without it. States still queued are dropped.
+ ****************************************************************************/
+
+void wcmThreadStop(LocalDevicePtr local)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	WacomThreadPtr thread = common->wcmThread;
+	WacomDevicePtr wDev;
+
+	if (!thread || thread->local != local)
+		return;
+
+	wcmThreadEnd(common, FALSE);
+
+	for (wDev = common->wcmDevices; wDev; wDev = wDev->next)
+	{
+		if (wDev->local != local && wDev->local->fd >= 0 &&
+				wDev->local->dev && wDev->local->dev->public.on)
+		{
+			if (wcmThreadStart(wDev->local) != Success)
+				wcmThreadFallback(common, local);
+			break;
+		}
+	}
+}
+
+/*****************************************************************************
+ * wcmThreadCancel --
+ *   The tablet can't be read in a thread anymore, e.g. because touch
+ *   gestures were turned on. Stop the thread for good and read the tablet
+ *   in the server from now on.
+ ****************************************************************************/
+
+void wcmThreadCancel(WacomCommonPtr common)
+{
+	if (!common->wcmThread)
+		return;
+
+	wcmThreadEnd(common, TRUE);
+	common->wcmThreaded = 0;
+	wcmThreadFallback(common, NULL);
+}
+
+/*****************************************************************************
+ * wcmThreadPause --
+ *   Wait for the thread to finish the read it is in and keep it from
+ *   starting another one, until wcmThreadResume. Calls nest; does
+ *   nothing without a thread.
+ ****************************************************************************/
+
+void wcmThreadPause(WacomCommonPtr common)
+{
+	WacomThreadPtr thread = common->wcmThread;
+
+	if (thread && !thread->paused++)
+		pthread_mutex_lock(&thread->lock);
+}
+
+/*****************************************************************************
+ * wcmThreadResume --
+ *   Let the thread read again. It may have been stopped meanwhile.
+ ****************************************************************************/
+
+void wcmThreadResume(WacomCommonPtr common)
+{
+	WacomThreadPtr thread = common->wcmThread;
+
+	if (thread && thread->paused && !--thread->paused)
+		pthread_mutex_unlock(&thread->lock);
+}
+/* vim: set noexpandtab shiftwidth=8: */
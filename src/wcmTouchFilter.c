@@ -110,6 +110,7 @@ static void xf86WcmSwitchLeftClick(WacomDevicePtr priv)
 					priv->flags & ABSOLUTE_FLAG,
 					1,0,0,priv->naxes, priv->oldX,
 					priv->oldY,0,0,0,0);
+		priv->posted[WCM_POSTED_BUTTON]++;
 		priv->oldButtons = 0;
 	}
 }
@@ -128,6 +129,7 @@ void xf86WcmFingerTapToClick(WacomCommonPtr common)
 	WacomDeviceState dsLast[2] = { firstChannel->valid.states[1],
 					secondChannel->valid.states[1] };
 	int direction = 0;
+	int now = ds[1].sample; /* tablet time of the second finger data */
 
 	DBG(10, priv, "\n");
 
@@ -146,7 +148,7 @@ void xf86WcmFingerTapToClick(WacomCommonPtr common)
 	if (priv)  /* found the first finger */
 	{
 		/* allow only second finger tap */
-		if ((dsLast[0].sample < dsLast[1].sample) && ((GetTimeInMillis() -
+		if ((dsLast[0].sample < dsLast[1].sample) && ((now -
 						dsLast[1].sample) <= WACOM_TAP_TIME_IN_MS))
 		{
 			/* send right click when second finger taps within WACOM_TAP_TIMEms
@@ -172,11 +174,12 @@ void xf86WcmFingerTapToClick(WacomCommonPtr common)
 							priv->flags & ABSOLUTE_FLAG,
 							3,0,0,priv->naxes, priv->oldX,
 							priv->oldY,0,0,0,0);
+					priv->posted[WCM_POSTED_BUTTON] += 2;
 				}
 			}
 		}
-		else if ((WACOM_TAP_TIME_IN_MS < (GetTimeInMillis() - dsLast[0].sample))
-				&& (WACOM_TAP_TIME_IN_MS < (GetTimeInMillis() - dsLast[1].sample))
+		else if ((WACOM_TAP_TIME_IN_MS < (now - dsLast[0].sample))
+				&& (WACOM_TAP_TIME_IN_MS < (now - dsLast[1].sample))
 				&& ds[0].proximity && ds[1].proximity)
 		{
 			if (abs(touchDistance(ds[0], ds[1])) >= WACOM_APART_IN_POINT &&
@@ -247,6 +250,7 @@ static void xf86WcmSendVerticalScrollEvent(WacomDevicePtr priv,
 					priv->flags & ABSOLUTE_FLAG,
 					up,0,0,priv->naxes, priv->oldX,
 					priv->oldY,0,0,0,0);
+			priv->posted[WCM_POSTED_BUTTON] += 2;
 		}
 		else
 		{
@@ -260,6 +264,7 @@ static void xf86WcmSendVerticalScrollEvent(WacomDevicePtr priv,
 					priv->flags & ABSOLUTE_FLAG,
 					dn,0,0,priv->naxes, priv->oldX,
 					priv->oldY,0,0,0,0);
+			priv->posted[WCM_POSTED_BUTTON] += 2;
 		}
 	}
 }
@@ -284,6 +289,7 @@ static void xf86WcmSendHorizontalScrollEvent(WacomDevicePtr priv,
 					priv->flags & ABSOLUTE_FLAG,
 					left,0,0,priv->naxes, priv->oldX,
 					priv->oldY,0,0,0,0);
+			priv->posted[WCM_POSTED_BUTTON] += 2;
 		}
 		else
 		{
@@ -297,6 +303,7 @@ static void xf86WcmSendHorizontalScrollEvent(WacomDevicePtr priv,
 					priv->flags & ABSOLUTE_FLAG,
 					right,0,0,priv->naxes, priv->oldX,
 					priv->oldY,0,0,0,0);
+			priv->posted[WCM_POSTED_BUTTON] += 2;
 		}
 	}
 }
@@ -0,0 +1,312 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xf86Wacom.h"
+#include "wacom-trace.h"
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#if DEBUG
+
+/*****************************************************************************
+ * Trace ring
+ *
+ * DBG() call sites up to wcmTraceLevel also land here: the time, where
+ * they are and the arguments of their format, no formatting and no
+ * syscall. The newest TRACE_RING_SIZE of them are kept in a ring shared
+ * by all tablets and threads; a writer claims a slot with an atomic add
+ * and fills it in. wcmTraceDump writes the ring to a file for wcmtrace to
+ * decode, see include/wacom-trace.h. Slots written while the dump runs
+ * may come out torn, it doesn't stop anyone.
+ ****************************************************************************/
+
+#define TRACE_RING_SIZE  16384  /* records, a power of two */
+#define TRACE_HASH_SIZE  4096   /* distinct strings a dump can name */
+
+typedef struct
+{
+	int64_t time_ns;
+	const char* name;
+	const char* func;
+	const char* format;
+	int level;
+	int nargs;
+	int64_t args[WACOM_TRACE_ARGS];
+} WacomTraceEntry;
+
+int wcmTraceLevel;              /* DBG levels recorded, 0 for none */
+
+static WacomTraceEntry* wcmTraceRing;
+static volatile unsigned int wcmTraceHead;
+
+/* stands in for the names of removed devices */
+static const char wcmTraceRemoved[] = "(removed)";
+
+/*****************************************************************************
+ * wcmTrace --
+ *   Record one DBG() call. The format is only scanned for what it
+ *   converts, like printf would, to take the arguments off the list.
+ ****************************************************************************/
+
+void wcmTrace(const char* name, const char* func, int level,
+	const char* format, ...)
+{
+	WacomTraceEntry* e;
+	struct timespec ts;
+	const char* p;
+	const char* s;
+	int longs, n = 0;
+	va_list args;
+
+	if (!wcmTraceRing)
+		return;
+
+	e = &wcmTraceRing[__sync_fetch_and_add(&wcmTraceHead, 1) &
+		(TRACE_RING_SIZE - 1)];
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	e->time_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	e->name = name;
+	e->func = func;
+	e->format = format;
+	e->level = level;
+
+	va_start(args, format);
+	for (p = format; *p && n < WACOM_TRACE_ARGS; p++)
+	{
+		if (*p != '%')
+			continue;
+		p += strspn(p + 1, "-+ #0123456789.") + 1;
+		for (longs = 0; *p == 'l' || *p == 'z' || *p == 'h'; p++)
+			if (*p != 'h')
+				longs++;
+
+		switch (*p)
+		{
+			case 'd': case 'i': case 'c':
+				e->args[n++] = longs > 1 ? va_arg(args, long long) :
+					longs ? va_arg(args, long) :
+					va_arg(args, int);
+				break;
+			case 'u': case 'x': case 'X': case 'o':
+				e->args[n++] = longs > 1 ?
+					(int64_t)va_arg(args, unsigned long long) :
+					longs ? va_arg(args, unsigned long) :
+					va_arg(args, unsigned int);
+				break;
+			case 'p':
+				e->args[n++] = (intptr_t)va_arg(args, void*);
+				break;
+			case 'e': case 'f': case 'g':
+			{
+				double d = va_arg(args, double);
+				memcpy(&e->args[n++], &d, sizeof(d));
+				break;
+			}
+			case 's':
+				s = va_arg(args, const char*);
+				e->args[n] = 0;
+				if (s)
+					strncpy((char*)&e->args[n], s,
+						sizeof(e->args[n]));
+				n++;
+				break;
+			case '\0':
+				p--;
+				break;
+		}
+	}
+	va_end(args);
+	e->nargs = n;
+}
+
+/*****************************************************************************
+ * wcmTraceSetLevel --
+ *   Start or stop recording. The ring is allocated the first time and
+ *   kept, a writer may still be in it.
+ ****************************************************************************/
+
+int wcmTraceSetLevel(int level)
+{
+	if (level && !wcmTraceRing)
+	{
+		WacomTraceEntry* ring;
+
+		ring = xcalloc(TRACE_RING_SIZE, sizeof(WacomTraceEntry));
+		if (!ring)
+			return FALSE;
+		wcmTraceRing = ring;
+		__sync_synchronize();
+	}
+	wcmTraceLevel = level;
+	return TRUE;
+}
+
+/*****************************************************************************
+ * wcmTraceForget --
+ *   A device is going away and its name with it; the records it left
+ *   can't point to it any longer.
+ ****************************************************************************/
+
+void wcmTraceForget(const char* name)
+{
+	int i;
+
+	if (!wcmTraceRing)
+		return;
+
+	for (i = 0; i < TRACE_RING_SIZE; i++)
+		if (wcmTraceRing[i].name == name)
+			wcmTraceRing[i].name = wcmTraceRemoved;
+}
+
+/*****************************************************************************
+ * wcmTraceString --
+ *   Index of a string in the dump, adding it to the table if it's new.
+ *   Strings are told apart by their address, which is all that's known
+ *   about them until they are written out.
+ ****************************************************************************/
+
+static uint32_t wcmTraceString(const char** table, uint32_t* index,
+	uint32_t* count, const char* str)
+{
+	unsigned int h;
+
+	if (!str)
+		str = wcmTraceRemoved;
+
+	h = ((uintptr_t)str >> 3) & (TRACE_HASH_SIZE - 1);
+	while (table[h] && table[h] != str)
+		h = (h + 1) & (TRACE_HASH_SIZE - 1);
+
+	if (!table[h])
+	{
+		/* a full table names the rest after the first string */
+		if (*count == TRACE_HASH_SIZE - 1)
+			return 0;
+		table[h] = str;
+		index[h] = (*count)++;
+	}
+	return index[h];
+}
+
+static int wcmTraceWrite(int fd, const void* data, size_t len)
+{
+	const char* p = data;
+	ssize_t n;
+
+	while (len)
+	{
+		SYSCALL(n = write(fd, p, len));
+		if (n < 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ * wcmTraceDump --
+ *   Write what the ring holds to path, replacing the file. Returns 0, or
+ *   -1 with errno set.
+ ****************************************************************************/
+
+int wcmTraceDump(const char* path)
+{
+	WacomTraceHeader hdr;
+	WacomTraceRecord* recs = NULL;
+	const char** table = NULL;
+	const char** strings = NULL;
+	uint32_t* index = NULL;
+	unsigned int head, first, i;
+	uint32_t len;
+	int fd = -1, rc = -1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, WACOM_TRACE_MAGIC);
+	hdr.version = WACOM_TRACE_VERSION;
+	hdr.record_size = sizeof(WacomTraceRecord);
+
+	head = wcmTraceHead;
+	first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+	if (!wcmTraceRing)
+		first = head;
+
+	recs = xcalloc(TRACE_RING_SIZE, sizeof(WacomTraceRecord));
+	table = xcalloc(TRACE_HASH_SIZE, sizeof(char*));
+	strings = xcalloc(TRACE_HASH_SIZE, sizeof(char*));
+	index = xcalloc(TRACE_HASH_SIZE, sizeof(uint32_t));
+	if (!recs || !table || !strings || !index)
+	{
+		errno = ENOMEM;
+		goto out;
+	}
+
+	for (i = first; i != head; i++)
+	{
+		const WacomTraceEntry* e =
+			&wcmTraceRing[i & (TRACE_RING_SIZE - 1)];
+		WacomTraceRecord* r = &recs[hdr.records++];
+
+		r->time_ns = e->time_ns;
+		r->name = wcmTraceString(table, index, &hdr.strings, e->name);
+		r->func = wcmTraceString(table, index, &hdr.strings, e->func);
+		r->format = wcmTraceString(table, index, &hdr.strings,
+			e->format);
+		r->level = e->level;
+		r->nargs = e->nargs;
+		memcpy(r->args, e->args, sizeof(r->args));
+	}
+
+	for (i = 0; i < TRACE_HASH_SIZE; i++)
+		if (table[i])
+			strings[index[i]] = table[i];
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		goto out;
+
+	if (wcmTraceWrite(fd, &hdr, sizeof(hdr)) ||
+			wcmTraceWrite(fd, recs,
+				hdr.records * sizeof(WacomTraceRecord)))
+		goto out;
+
+	for (i = 0; i < hdr.strings; i++)
+	{
+		len = strlen(strings[i]);
+		if (wcmTraceWrite(fd, &len, sizeof(len)) ||
+				wcmTraceWrite(fd, strings[i], len))
+			goto out;
+	}
+	rc = 0;
+
+out:
+	if (fd >= 0 && close(fd) && !rc)
+		rc = -1;
+	xfree(recs);
+	xfree(table);
+	xfree(strings);
+	xfree(index);
+	return rc;
+}
+
+#endif /* DEBUG */
+/* vim: set noexpandtab shiftwidth=8: */
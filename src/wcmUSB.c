@@ -25,6 +25,8 @@
 #include "wcmFilter.h"
 
 #include <sys/utsname.h>
+#include <stddef.h>
+#include <time.h>
 
 #ifndef BTN_TASK
 #define BTN_TASK 0x117
@@ -34,6 +36,14 @@
 #define BTN_TOOL_TRIPLETAP 0x14e
 #endif
 
+#ifndef EVIOCSCLOCKID
+#define EVIOCSCLOCKID _IOW('E', 0xa0, int)
+#endif
+
+#ifndef SYN_DROPPED
+#define SYN_DROPPED 3
+#endif
+
 static Bool usbDetect(LocalDevicePtr);
 Bool usbWcmInit(LocalDevicePtr pDev, char* id, float *version);
 
@@ -42,12 +52,16 @@ static void usbInitProtocol5(WacomCommonPtr common, const char* id,
 static void usbInitProtocol4(WacomCommonPtr common, const char* id,
 	float version);
 int usbWcmGetRanges(LocalDevicePtr local);
-static int usbParse(LocalDevicePtr local, const unsigned char* data);
+static int usbParse(LocalDevicePtr local, const unsigned char* data, int len);
 static int usbDetectConfig(LocalDevicePtr local);
-static void usbParseEvent(LocalDevicePtr local,
+static int usbParseEvent(LocalDevicePtr local,
 	const struct input_event* event);
-static void usbParseChannel(LocalDevicePtr local, int channel);
+static void usbParseFrame(LocalDevicePtr local,
+	const struct input_event* events, int nevents);
+static void usbParseChannel(LocalDevicePtr local, int channel,
+	const struct input_event* events, int nevents);
 static int usbChooseChannel(WacomCommonPtr common, int serial);
+static void usbResync(LocalDevicePtr local);
 
 	WacomDeviceClass gWacomUSBDevice =
 	{
@@ -500,9 +514,170 @@ static struct
 	{ 0xE3, 2540, 2540, &usbTabletPC   }  /* TabletPC 0xE3 */
 };
 
-Bool usbWcmInit(LocalDevicePtr local, char* id, float *version)
+/*****************************************************************************
+ * usbCountBits -- number of codes up to max set in an EVIOCGBIT bitmask
+ ****************************************************************************/
+
+static int usbCountBits(const unsigned long* bits, int max)
+{
+	int i, n = 0;
+
+	for (i = 0; i <= max; i++)
+		if ((bits[i / BITS_PER_LONG] >> (i % BITS_PER_LONG)) & 1)
+			n++;
+	return n;
+}
+
+/*****************************************************************************
+ * usbInitEventQueue --
+ *   Size the staging area for frames straddling two reads after the largest
+ *   frame the device can produce: each key, axis, relative and misc code it
+ *   supports, once per finger, plus the SYN_REPORT.
+ ****************************************************************************/
+
+static Bool usbInitEventQueue(LocalDevicePtr local, const unsigned long* keys)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	unsigned long bits[NBITS(ABS_MAX)];
+	struct input_event* events;
+	int ncodes = usbCountBits(keys, KEY_MAX);
+	int nevents;
+
+	memset(bits, 0, sizeof(bits));
+	if (ioctl(local->fd, EVIOCGBIT(EV_ABS, sizeof(bits)), bits) >= 0)
+		ncodes += usbCountBits(bits, ABS_MAX);
+
+	memset(bits, 0, sizeof(bits));
+	if (ioctl(local->fd, EVIOCGBIT(EV_REL, sizeof(bits)), bits) >= 0)
+		ncodes += usbCountBits(bits, REL_MAX);
+
+	memset(bits, 0, sizeof(bits));
+	if (ioctl(local->fd, EVIOCGBIT(EV_MSC, sizeof(bits)), bits) >= 0)
+		ncodes += usbCountBits(bits, MSC_MAX);
+
+	nevents = MAX_FINGERS * ncodes + 1;
+	if (nevents < MAX_USB_EVENTS)
+		nevents = MAX_USB_EVENTS;
+
+	DBG(3, common, "staging up to %d events per frame\n", nevents);
+
+	if (nevents <= common->wcmEventMax)
+		return TRUE;
+
+	events = xrealloc(common->wcmEvents, nevents * sizeof(*events));
+	if (!events)
+	{
+		xf86Msg(X_ERROR, "%s: unable to allocate event queue.\n",
+			local->name);
+		return FALSE;
+	}
+
+	common->wcmEvents = events;
+	common->wcmEventMax = nevents;
+	common->wcmEventCnt = 0;
+	return TRUE;
+}
+
+/* event decoding handlers, see WacomEventMap */
+#define USB_DECODE_NONE         0       /* ignored */
+#define USB_DECODE_FIELD        1       /* arg is the WacomDeviceState offset */
+#define USB_DECODE_TILT_X       2
+#define USB_DECODE_TILT_Y       3
+#define USB_DECODE_PRESSURE     4       /* pressure, or capacity for touch */
+#define USB_DECODE_MISC         5       /* V5 tools report device_id */
+#define USB_DECODE_TOOL         6       /* arg is the device type */
+#define USB_DECODE_PAD          7
+#define USB_DECODE_TOUCH        8
+#define USB_DECODE_TOUCH2       9       /* second finger */
+#define USB_DECODE_BUTTON       10      /* arg is the button bit */
+#define USB_DECODE_PADKEY       11      /* arg is the pad button bit */
+
+#define USB_MAP(map, code, h, a, c) do { \
+		(map)[code].handler = (h); \
+		(map)[code].arg = (a); \
+		(map)[code].changed = (c); \
+	} while (0)
+
+#define USB_MAP_FIELD(code, field, c) \
+	USB_MAP(common->wcmAbsMap, code, USB_DECODE_FIELD, \
+		offsetof(WacomDeviceState, field), c)
+
+/*****************************************************************************
+ * usbInitDecodeTables --
+ *   Build the per-code decoding tables used by usbParseChannel. Pad keys
+ *   are looked up here once, fixed button codes take precedence over them.
+ ****************************************************************************/
+
+static void usbInitDecodeTables(WacomCommonPtr common)
 {
 	int i;
+
+	memset(common->wcmAbsMap, 0, sizeof(common->wcmAbsMap));
+	memset(common->wcmKeyMap, 0, sizeof(common->wcmKeyMap));
+
+	USB_MAP_FIELD(ABS_X, x, WCM_CHANGED_X);
+	USB_MAP_FIELD(ABS_Y, y, WCM_CHANGED_Y);
+	USB_MAP_FIELD(ABS_RX, stripx, WCM_CHANGED_STRIP);
+	USB_MAP_FIELD(ABS_RY, stripy, WCM_CHANGED_STRIP);
+	USB_MAP_FIELD(ABS_RZ, rotation, WCM_CHANGED_ROTATION);
+	USB_MAP_FIELD(ABS_DISTANCE, distance, WCM_CHANGED_DISTANCE);
+	USB_MAP_FIELD(ABS_WHEEL, abswheel, WCM_CHANGED_WHEEL);
+	USB_MAP_FIELD(ABS_Z, abswheel, WCM_CHANGED_WHEEL);
+	USB_MAP_FIELD(ABS_THROTTLE, throttle, WCM_CHANGED_THROTTLE);
+	USB_MAP(common->wcmAbsMap, ABS_TILT_X, USB_DECODE_TILT_X, 0,
+		WCM_CHANGED_TILT);
+	USB_MAP(common->wcmAbsMap, ABS_TILT_Y, USB_DECODE_TILT_Y, 0,
+		WCM_CHANGED_TILT);
+	USB_MAP(common->wcmAbsMap, ABS_PRESSURE, USB_DECODE_PRESSURE, 0,
+		WCM_CHANGED_PRESSURE | WCM_CHANGED_CAPACITY);
+	USB_MAP(common->wcmAbsMap, ABS_MISC, USB_DECODE_MISC, 0,
+		WCM_CHANGED_TOOL);
+
+	for (i = 0; i < common->npadkeys; i++)
+		USB_MAP(common->wcmKeyMap, common->padkey_code[i],
+			USB_DECODE_PADKEY, i, WCM_CHANGED_BUTTONS);
+
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_PEN, USB_DECODE_TOOL, STYLUS_ID,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_PENCIL, USB_DECODE_TOOL, STYLUS_ID,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_BRUSH, USB_DECODE_TOOL, STYLUS_ID,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_AIRBRUSH, USB_DECODE_TOOL, STYLUS_ID,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_RUBBER, USB_DECODE_TOOL, ERASER_ID,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_MOUSE, USB_DECODE_TOOL, CURSOR_ID,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_LENS, USB_DECODE_TOOL, CURSOR_ID,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_FINGER, USB_DECODE_PAD, 0,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_DOUBLETAP, USB_DECODE_TOUCH, 0,
+		WCM_CHANGED_TOOL);
+	USB_MAP(common->wcmKeyMap, BTN_TOOL_TRIPLETAP, USB_DECODE_TOUCH2, 0,
+		WCM_CHANGED_TOOL);
+
+	USB_MAP(common->wcmKeyMap, BTN_LEFT, USB_DECODE_BUTTON, 0,
+		WCM_CHANGED_BUTTONS);
+	USB_MAP(common->wcmKeyMap, BTN_STYLUS, USB_DECODE_BUTTON, 1,
+		WCM_CHANGED_BUTTONS);
+	USB_MAP(common->wcmKeyMap, BTN_MIDDLE, USB_DECODE_BUTTON, 1,
+		WCM_CHANGED_BUTTONS);
+	USB_MAP(common->wcmKeyMap, BTN_STYLUS2, USB_DECODE_BUTTON, 2,
+		WCM_CHANGED_BUTTONS);
+	USB_MAP(common->wcmKeyMap, BTN_RIGHT, USB_DECODE_BUTTON, 2,
+		WCM_CHANGED_BUTTONS);
+	USB_MAP(common->wcmKeyMap, BTN_SIDE, USB_DECODE_BUTTON, 3,
+		WCM_CHANGED_BUTTONS);
+	USB_MAP(common->wcmKeyMap, BTN_EXTRA, USB_DECODE_BUTTON, 4,
+		WCM_CHANGED_BUTTONS);
+}
+
+Bool usbWcmInit(LocalDevicePtr local, char* id, float *version)
+{
+	int i, clockid = CLOCK_MONOTONIC;
 	struct input_id sID;
 	unsigned long keys[NBITS(KEY_MAX)] = {0};
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
@@ -522,6 +697,9 @@ Bool usbWcmInit(LocalDevicePtr local, char* id, float *version)
 		return FALSE;
 	}
 
+	if (!usbInitEventQueue(local, keys))
+		return !Success;
+
 	/* vendor is wacom */
 	if (sID.vendor == WACOM_VENDOR_ID)
 	{
@@ -575,6 +753,22 @@ Bool usbWcmInit(LocalDevicePtr local, char* id, float *version)
 	else
 		common->nbuttons = 5;
 
+	usbInitDecodeTables(common);
+
+	/* read as many whole events as fit in the reception buffer */
+	wcmRingInit(&common->wcmRing, common->buffer, USB_BUFFER_SIZE);
+	common->wcmResync = 0;
+
+	/* event times are only comparable with ours on the same clock,
+	 * older kernels can't switch so we use the time of the read */
+	if (ioctl(local->fd, EVIOCSCLOCKID, &clockid) == 0)
+		common->wcmFlags |= MONOTONIC_TIME_FLAG;
+	else
+	{
+		DBG(1, priv, "kernel event times unusable, using read times\n");
+		common->wcmFlags &= ~MONOTONIC_TIME_FLAG;
+	}
+
 	return Success;
 }
 
@@ -734,13 +928,119 @@ static int usbDetectConfig(LocalDevicePtr local)
 	return TRUE;
 }
 
-static int usbParse(LocalDevicePtr local, const unsigned char* data)
+/* frame boundaries, as returned by usbParseEvent */
+#define USB_FRAME_MORE    0     /* event belongs to the current frame */
+#define USB_FRAME_END     1     /* event terminates the current frame */
+#define USB_FRAME_RESTART 2     /* drop the current frame, this event included */
+#define USB_FRAME_DROPPED 3     /* the kernel dropped events, resync */
+
+/*****************************************************************************
+ * usbStageEvents --
+ *   Append events to the staging area, for frames that straddle two reads.
+ *   Returns FALSE and drops the frame if it doesn't fit.
+ ****************************************************************************/
+
+static Bool usbStageEvents(LocalDevicePtr local,
+	const struct input_event* events, int nevents)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+
+	/* space left? bail if not. The staging area is sized for the
+	 * largest frame the device can produce, so this shouldn't happen;
+	 * we can't grow it here, we're called from the SIGIO handler. */
+	if (common->wcmEventCnt + nevents > common->wcmEventMax)
+	{
+		common->wcmStats[WCM_STAT_OVERFLOWS]++;
+		if (wcmReaderThread)
+			common->wcmNotes[WCM_NOTE_OVERFLOW]++;
+		else
+			xf86Msg(X_ERROR, "%s: usbParse: Exceeded event queue (%d) \n",
+				local->name, common->wcmEventCnt + nevents);
+		common->wcmLastToolSerial = 0;
+		common->wcmEventCnt = 0;
+		return FALSE;
+	}
+
+	memcpy(common->wcmEvents + common->wcmEventCnt, events,
+		nevents * sizeof(struct input_event));
+	common->wcmEventCnt += nevents;
+	return TRUE;
+}
+
+/*****************************************************************************
+ * usbParse --
+ *   Decode the next frame right where it sits in the reception buffer.
+ *   Only a frame cut short by the end of the data read so far is copied
+ *   to the staging area, where the rest of it is appended on the next read.
+ ****************************************************************************/
+
+static int usbParse(LocalDevicePtr local, const unsigned char* data, int len)
 {
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
 	WacomCommonPtr common = priv->common;
+	const struct input_event* events = (const struct input_event*)data;
+	int nevents = len / sizeof(struct input_event);
+	int i, start = 0;
+
+	if (!nevents)
+		return 0;
+
+	DBG(10, common, "%d events pending\n", nevents);
+
+	for (i = 0; i < nevents; i++)
+	{
+		/* after a SYN_DROPPED everything up to the next SYN_REPORT
+		 * is what's left of a frame we partly lost */
+		if (common->wcmResync)
+		{
+			if (events[i].type == EV_SYN && events[i].code == SYN_REPORT)
+			{
+				common->wcmResync = 0;
+				usbResync(local);
+				return (i + 1) * sizeof(struct input_event);
+			}
+			continue;
+		}
+
+		switch (usbParseEvent(local, events + i))
+		{
+			case USB_FRAME_DROPPED:
+				common->wcmStats[WCM_STAT_SYN_DROPPED]++;
+				DBG(1, common, "kernel dropped events (%u times)\n",
+					common->wcmStats[WCM_STAT_SYN_DROPPED]);
+				common->wcmResync = 1;
+				common->wcmLastToolSerial = 0;
+				common->wcmEventCnt = 0;
+				break;
+
+			case USB_FRAME_RESTART:
+				/* start over with the next event */
+				common->wcmLastToolSerial = 0;
+				common->wcmEventCnt = 0;
+				start = i + 1;
+				break;
+
+			case USB_FRAME_END:
+				if (!common->wcmEventCnt)
+					usbParseFrame(local, events + start,
+						i + 1 - start);
+				/* the frame started in an earlier read */
+				else if (usbStageEvents(local, events + start,
+						i + 1 - start))
+					usbParseFrame(local, common->wcmEvents,
+						common->wcmEventCnt);
+
+				common->wcmLastToolSerial = 0;
+				common->wcmEventCnt = 0;
+				return (i + 1) * sizeof(struct input_event);
+		}
+	}
 
-	usbParseEvent(local, (const struct input_event*)data);
-	return common->wcmPktLength;
+	/* no terminator yet, keep the events until the rest comes in */
+	if (!common->wcmResync)
+		usbStageEvents(local, events + start, nevents - start);
+	return nevents * sizeof(struct input_event);
 }
 
 static int usbChooseChannel(WacomCommonPtr common, int serial)
@@ -809,6 +1109,7 @@ static int usbChooseChannel(WacomCommonPtr common, int serial)
 					(common->wcmChannel[i].work.serial_num != -1))
 			{
 				common->wcmChannel[i].work.proximity = 0;
+				common->wcmChannel[i].work.time_us = common->wcmRecvTime;
 				/* dispatch event */
 				wcmEvent(common, i, &common->wcmChannel[i].work);
 			}
@@ -823,39 +1124,31 @@ static int usbChooseChannel(WacomCommonPtr common, int serial)
 	return channel;
 }
 
-static void usbParseEvent(LocalDevicePtr local,
+/*****************************************************************************
+ * usbParseEvent --
+ *   Check whether an event ends the current frame. We collect events until
+ *   we receive the MSC_SERIAL containing the serial number (or SYN_REPORT);
+ *   without it we cannot determine the correct channel.
+ ****************************************************************************/
+
+static int usbParseEvent(LocalDevicePtr local,
 	const struct input_event* event)
 {
-	int channel;
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
 	WacomCommonPtr common = priv->common;
 
-	DBG(10, common, "\n");
-	/* store events until we receive the MSC_SERIAL containing
-	 * the serial number; without it we cannot determine the
-	 * correct channel. */
-
-	/* space left? bail if not. */
-	if (common->wcmEventCnt >=
-		(sizeof(common->wcmEvents)/sizeof(*common->wcmEvents)))
-	{
-		xf86Msg(X_ERROR, "%s: usbParse: Exceeded event queue (%d) \n",
-			local->name, common->wcmEventCnt);
-		goto skipEvent;
-	}
-
-	/* save it for later */
-	common->wcmEvents[common->wcmEventCnt++] = *event;
-
 	if ((event->type == EV_MSC) && (event->code == MSC_SERIAL))
 	{
 		/* we don't report serial numbers for some tools
 		 * but we never report a serial number with a value of 0 */
 		if (event->value == 0)
 		{
-			xf86Msg(X_ERROR, "%s: usbParse: Ignoring event from invalid serial 0\n",
-				local->name);
-			goto skipEvent;
+			if (wcmReaderThread)
+				common->wcmNotes[WCM_NOTE_SERIAL0]++;
+			else
+				xf86Msg(X_ERROR, "%s: usbParse: Ignoring event from invalid serial 0\n",
+					local->name);
+			return USB_FRAME_RESTART;
 		}
 
 		/* save the serial number so we can look up the channel number later */
@@ -863,42 +1156,63 @@ static void usbParseEvent(LocalDevicePtr local,
 
 		/* if SYN_REPORT is end of record indicator, we are done */
 		if (USE_SYN_REPORTS(common))
-			return;
+			return USB_FRAME_MORE;
 
-		/* fall through to deliver the X event */
-	} else if ((event->type == EV_SYN) && (event->code == SYN_REPORT))
+		/* deliver the X event */
+		return USB_FRAME_END;
+	}
+	else if ((event->type == EV_SYN) && (event->code == SYN_DROPPED))
+		return USB_FRAME_DROPPED;
+	else if ((event->type == EV_SYN) && (event->code == SYN_REPORT))
 	{
 		/* if we got a SYN_REPORT but weren't expecting one, change over to
 		   using SYN_REPORT as the end of record indicator */
 		if (! USE_SYN_REPORTS(common))
 		{
-			xf86Msg(X_ERROR, "%s: Got unexpected SYN_REPORT, changing mode\n",
-				local->name);
+			if (wcmReaderThread)
+				common->wcmNotes[WCM_NOTE_SYN_REPORT]++;
+			else
+				xf86Msg(X_ERROR, "%s: Got unexpected SYN_REPORT, changing mode\n",
+					local->name);
 
 			/* we can expect SYN_REPORT's from now on */
 			common->wcmFlags |= USE_SYN_REPORTS_FLAG;
 		}
 
-		/* end of record. fall through to deliver the X event */
-	}
-	else
-	{
-		/* not an SYN_REPORT and not an SYN_REPORT, bail out */
-		return;
+		/* end of record. deliver the X event */
+		return USB_FRAME_END;
 	}
 
+	/* not an MSC_SERIAL and not an SYN_REPORT, keep going */
+	return USB_FRAME_MORE;
+}
+
+/*****************************************************************************
+ * usbParseFrame --
+ *   Pick the channel for a complete frame and decode it.
+ ****************************************************************************/
+
+static void usbParseFrame(LocalDevicePtr local,
+	const struct input_event* events, int nevents)
+{
+	int channel;
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+
+	DBG(10, common, "\n");
+
 	/* ignore events without information */
-	if ((common->wcmEventCnt <= 2) && common->wcmLastToolSerial)
+	if ((nevents <= 2) && common->wcmLastToolSerial)
 	{
 		DBG(3, common, "%s: dropping empty event"
 			" for serial %d\n", local->name, common->wcmLastToolSerial);
-		goto skipEvent;
+		return;
 	}
 
 	channel = usbChooseChannel(common, common->wcmLastToolSerial);
 
 	/* couldn't decide channel? invalid data */
-	if (channel == -1) goto skipEvent;
+	if (channel == -1) return;
 
 	if (!common->wcmChannel[channel].work.proximity)
 	{
@@ -908,201 +1222,164 @@ static void usbParseEvent(LocalDevicePtr local,
 	}
 
 	/* dispatch event */
-	usbParseChannel(local,channel);
-
-skipEvent:
-	common->wcmLastToolSerial = 0;
-	common->wcmEventCnt = 0;
+	usbParseChannel(local, channel, events, nevents);
 }
 
-static void usbParseChannel(LocalDevicePtr local, int channel)
+static void usbParseChannel(LocalDevicePtr local, int channel,
+	const struct input_event* events, int nevents)
 {
-	int i, shift, nkeys;
+	int i, shift;
 	WacomDeviceState* ds;
-	struct input_event* event;
+	const struct input_event* event;
+	const WacomEventMap* map;
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
 	WacomCommonPtr common = priv->common;
 
-	DBG(6, common, "%d events received\n", common->wcmEventCnt);
+	DBG(6, common, "%d events received\n", nevents);
 	#define MOD_BUTTONS(bit, value) do { \
 		shift = 1<<bit; \
 		ds->buttons = (((value) != 0) ? \
 		(ds->buttons | (shift)) : (ds->buttons & ~(shift))); \
 		} while (0)
 
-	if (common->wcmEventCnt == 1 && !common->wcmEvents->type) {
+	if (nevents == 1 && !events->type) {
 		DBG(6, common, "no real events received\n");
 		return;
 	}
-	DBG(6, common, "%d events received\n", common->wcmEventCnt);
+	DBG(6, common, "%d events received\n", nevents);
 
 	/* all USB data operates from previous context except relative values*/
 	ds = &common->wcmChannel[channel].work;
+	ds->changed = ds->relwheel ? WCM_CHANGED_WHEEL : 0;
 	ds->relwheel = 0;
-	ds->serial_num = common->wcmLastToolSerial;
+
+	/* the frame was sampled when its last event was stamped */
+	event = events + nevents - 1;
+	if (common->wcmFlags & MONOTONIC_TIME_FLAG)
+		ds->time_us = (int64_t)event->time.tv_sec * 1000000 +
+			event->time.tv_usec;
+	else
+		ds->time_us = common->wcmRecvTime;
+
+	if (ds->serial_num != common->wcmLastToolSerial)
+	{
+		ds->serial_num = common->wcmLastToolSerial;
+		ds->changed |= WCM_CHANGED_TOOL;
+	}
 
 	/* loop through all events in group */
-	for (i=0; i<common->wcmEventCnt; ++i)
+	for (i=0; i<nevents; ++i)
 	{
-		event = common->wcmEvents + i;
+		event = events + i;
 		DBG(11, common,
 			"event[%d]->type=%d code=%d value=%d\n",
 			i, event->type, event->code, event->value);
 
 		/* absolute events */
-		if (event->type == EV_ABS)
+		if (event->type == EV_ABS && event->code <= ABS_MAX)
 		{
-			if (event->code == ABS_X)
-				ds->x = event->value;
-			else if (event->code == ABS_Y)
-				ds->y = event->value;
-			else if (event->code == ABS_RX)
-				ds->stripx = event->value; 
-			else if (event->code == ABS_RY)
-				ds->stripy = event->value;
-			else if (event->code == ABS_RZ) 
-				ds->rotation = event->value;
-			else if (event->code == ABS_TILT_X)
-				ds->tiltx = event->value - common->wcmMaxtiltX/2;
-			else if (event->code ==  ABS_TILT_Y)
-				ds->tilty = event->value - common->wcmMaxtiltY/2;
-			else if (event->code == ABS_PRESSURE) {
-				if (ds->device_type == TOUCH_ID)
-					ds->capacity = event->value;
-				else
-					ds->pressure = event->value;
-			} else if (event->code == ABS_DISTANCE)
-				ds->distance = event->value;
-			else if (event->code == ABS_WHEEL || 
-				    event->code == ABS_Z)
-				ds->abswheel = event->value;
-			else if (event->code == ABS_THROTTLE)
-				ds->throttle = event->value;
-			else if (event->code == ABS_MISC && event->value)
-				ds->device_id = event->value;
+			map = &common->wcmAbsMap[event->code];
+			ds->changed |= map->changed;
+			switch (map->handler)
+			{
+				case USB_DECODE_FIELD:
+					*(int*)((char*)ds + map->arg) = event->value;
+					break;
+				case USB_DECODE_TILT_X:
+					ds->tiltx = event->value - common->wcmMaxtiltX/2;
+					break;
+				case USB_DECODE_TILT_Y:
+					ds->tilty = event->value - common->wcmMaxtiltY/2;
+					break;
+				case USB_DECODE_PRESSURE:
+					if (ds->device_type == TOUCH_ID)
+						ds->capacity = event->value;
+					else
+						ds->pressure = event->value;
+					break;
+				case USB_DECODE_MISC:
+					if (event->value)
+						ds->device_id = event->value;
+					break;
+			}
 		}
 		else if (event->type == EV_REL)
 		{
 			if (event->code == REL_WHEEL)
+			{
 				ds->relwheel = -event->value;
+				ds->changed |= WCM_CHANGED_WHEEL;
+			}
+			else if (wcmReaderThread)
+				common->wcmNotes[WCM_NOTE_REL]++;
 			else
 				xf86Msg(X_ERROR, "%s: rel event recv'd (%d)!\n",
 					local->name, event->code);
 		}
 
-		else if (event->type == EV_KEY)
+		else if (event->type == EV_KEY && event->code <= KEY_MAX)
 		{
-			if ((event->code == BTN_TOOL_PEN) ||
-				(event->code == BTN_TOOL_PENCIL) ||
-				(event->code == BTN_TOOL_BRUSH) ||
-				(event->code == BTN_TOOL_AIRBRUSH))
+			map = &common->wcmKeyMap[event->code];
+			ds->changed |= map->changed;
+			switch (map->handler)
 			{
-				ds->device_type = STYLUS_ID;
-				/* V5 tools use ABS_MISC to report device_id */
-				if (common->wcmProtocolLevel == 4)
-					ds->device_id = STYLUS_DEVICE_ID;
-				ds->proximity = (event->value != 0);
-				DBG(6, common,
-					"USB stylus detected %x\n",
-					event->code);
-			}
-			else if (event->code == BTN_TOOL_RUBBER)
-			{
-				ds->device_type = ERASER_ID;
-				/* V5 tools use ABS_MISC to report device_id */
-				if (common->wcmProtocolLevel == 4)
-					ds->device_id = ERASER_DEVICE_ID;
-				ds->proximity = (event->value != 0);
-				if (ds->proximity)
-					ds->proximity = ERASER_PROX;
-				DBG(6, common, 
-					"USB eraser detected %x (value=%d)\n",
-					event->code, event->value);
-			}
-			else if ((event->code == BTN_TOOL_MOUSE) ||
-				(event->code == BTN_TOOL_LENS))
-			{
-				DBG(6, common, 
-					"USB mouse detected %x (value=%d)\n",
-					event->code, event->value);
-				ds->device_type = CURSOR_ID;
-				/* V5 tools use ABS_MISC to report device_id */
-				if (common->wcmProtocolLevel == 4)
-					ds->device_id = CURSOR_DEVICE_ID;
-				ds->proximity = (event->value != 0);
-			}
-			else if (event->code == BTN_TOOL_FINGER)
-			{
-				DBG(6, common, 
-					"USB Pad detected %x (value=%d)\n",
-					event->code, event->value);
-				ds->device_type = PAD_ID;
-				ds->device_id = PAD_DEVICE_ID;
-				ds->proximity = (event->value != 0);
-			}
-			else if (event->code == BTN_TOOL_DOUBLETAP)
-			{
-				WacomChannelPtr pChannel = common->wcmChannel + channel;
-				WacomDeviceState dslast = pChannel->valid.state;
-				DBG(6, common, 
-					"USB Touch detected %x (value=%d)\n",
-					event->code, event->value);
-				ds->device_type = TOUCH_ID;
-				ds->device_id = TOUCH_DEVICE_ID;
-				ds->proximity = event->value;
-				/* time stamp for 2FGT gesture events */
-				if ((ds->proximity && !dslast.proximity) ||
-					    (!ds->proximity && dslast.proximity))
-					ds->sample = (int)GetTimeInMillis();
-				/* left button is always pressed for touch without capacity
-				 * when the first finger touch event received.
-				 * For touch with capacity, left button event will be decided
-				 * in wcmCommon.c by capacity threshold
-				 */
-				if (common->wcmCapacityDefault < 0)
-					MOD_BUTTONS (0, event->value);
-			}
-			else if (event->code == BTN_TOOL_TRIPLETAP)
-			{
-				WacomChannelPtr pChannel = common->wcmChannel + channel;
-				WacomDeviceState dslast = pChannel->valid.state;
-				DBG(6, common, 
-					"USB Touch second finger detected %x (value=%d)\n",
-					event->code, event->value);
-				ds->device_type = TOUCH_ID;
-				ds->device_id = TOUCH_DEVICE_ID;
-				ds->proximity = event->value;
-				/* time stamp for 2GT gesture events */
-				if ((ds->proximity && !dslast.proximity) ||
-					    (!ds->proximity && dslast.proximity))
-					ds->sample = (int)GetTimeInMillis();
-				/* Second finger events will be considered in
-				 * combination with the first finger data */
-			}
-			else if ((event->code == BTN_STYLUS) ||
-				(event->code == BTN_MIDDLE))
-			{
-				MOD_BUTTONS (1, event->value);
-			}
-			else if ((event->code == BTN_STYLUS2) ||
-				(event->code == BTN_RIGHT))
-			{
-				MOD_BUTTONS (2, event->value);
-			}
-			else if (event->code == BTN_LEFT)
-				MOD_BUTTONS (0, event->value);
-			else if (event->code == BTN_SIDE)
-				MOD_BUTTONS (3, event->value);
-			else if (event->code == BTN_EXTRA)
-				MOD_BUTTONS (4, event->value);
-			else
-			{
-				for (nkeys = 0; nkeys < common->npadkeys; nkeys++)
-					if (event->code == common->padkey_code [nkeys])
-					{
-						MOD_BUTTONS (nkeys, event->value);
-						break;
-					}
+				case USB_DECODE_TOOL:
+					DBG(6, common, "USB %s detected %x (value=%d)\n",
+						map->arg == STYLUS_ID ? "stylus" :
+						map->arg == ERASER_ID ? "eraser" : "mouse",
+						event->code, event->value);
+					ds->device_type = map->arg;
+					/* V5 tools use ABS_MISC to report device_id */
+					if (common->wcmProtocolLevel == 4)
+						ds->device_id =
+							map->arg == STYLUS_ID ? STYLUS_DEVICE_ID :
+							map->arg == ERASER_ID ? ERASER_DEVICE_ID :
+							CURSOR_DEVICE_ID;
+					ds->proximity = (event->value != 0);
+					if (ds->proximity && map->arg == ERASER_ID)
+						ds->proximity = ERASER_PROX;
+					break;
+
+				case USB_DECODE_PAD:
+					DBG(6, common, 
+						"USB Pad detected %x (value=%d)\n",
+						event->code, event->value);
+					ds->device_type = PAD_ID;
+					ds->device_id = PAD_DEVICE_ID;
+					ds->proximity = (event->value != 0);
+					break;
+
+				case USB_DECODE_TOUCH:
+					DBG(6, common, 
+						"USB Touch detected %x (value=%d)\n",
+						event->code, event->value);
+					ds->device_type = TOUCH_ID;
+					ds->device_id = TOUCH_DEVICE_ID;
+					ds->proximity = event->value;
+					/* left button is always pressed for touch without capacity
+					 * when the first finger touch event received.
+					 * For touch with capacity, left button event will be decided
+					 * in wcmCommon.c by capacity threshold
+					 */
+					if (common->wcmCapacityDefault < 0)
+						MOD_BUTTONS (0, event->value);
+					break;
+
+				case USB_DECODE_TOUCH2:
+					DBG(6, common, 
+						"USB Touch second finger detected %x (value=%d)\n",
+						event->code, event->value);
+					ds->device_type = TOUCH_ID;
+					ds->device_id = TOUCH_DEVICE_ID;
+					ds->proximity = event->value;
+					/* Second finger events will be considered in
+					 * combination with the first finger data */
+					break;
+
+				case USB_DECODE_BUTTON:
+				case USB_DECODE_PADKEY:
+					MOD_BUTTONS (map->arg, event->value);
+					break;
 			}
 		}
 	} /* next event */
@@ -1123,4 +1400,167 @@ static void usbParseChannel(LocalDevicePtr local, int channel)
 	/* dispatch event */
 	wcmEvent(common, channel, ds);
 }
+
+/*****************************************************************************
+ * usbResyncTool --
+ *   Find the tool key of a channel after events were dropped: the key of
+ *   the tool in prox, or for a free channel a newly pressed one. Returns
+ *   the key code or -1, *down is set to the key state.
+ ****************************************************************************/
+
+static int usbResyncTool(WacomCommonPtr common, int channel,
+	const unsigned long* keys, int* down)
+{
+	const WacomDeviceState* ds = &common->wcmChannel[channel].work;
+	const WacomEventMap* map;
+	int code, type, first = -1;
+
+	for (code = 0; code <= KEY_MAX; code++)
+	{
+		map = &common->wcmKeyMap[code];
+		switch (map->handler)
+		{
+			case USB_DECODE_TOOL:
+				type = channel ? 0 : map->arg;
+				break;
+			case USB_DECODE_PAD:
+				type = PAD_ID;
+				break;
+			case USB_DECODE_TOUCH:
+				type = channel ? 0 : TOUCH_ID;
+				break;
+			case USB_DECODE_TOUCH2:
+				type = channel ? TOUCH_ID : 0;
+				break;
+			default:
+				continue;
+		}
+
+		/* a tool in prox keeps its type, protocol 4 only
+		 * reports pads and second fingers on channel 1 */
+		if (ds->proximity)
+		{
+			if (map->handler == USB_DECODE_TOOL)
+				type = map->arg;
+			if (type != ds->device_type)
+				continue;
+		}
+		else if (!type || (type == PAD_ID && !channel) ||
+				!ISBITSET(keys, code))
+			continue;
+
+		if (ISBITSET(keys, code))
+		{
+			*down = 1;
+			return code;
+		}
+		if (first < 0)
+			first = code;
+	}
+
+	*down = 0;
+	return first;
+}
+
+/*****************************************************************************
+ * usbResync --
+ *   Rebuild the channel work states from the kernel's current key and
+ *   axis state after it dropped events, and dispatch them as a frame
+ *   each. A new V5 tool stays unknown until its next frame, as only the
+ *   lost MSC_SERIAL tells us its channel.
+ ****************************************************************************/
+
+static void usbResync(LocalDevicePtr local)
+{
+	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
+	unsigned long keys[NBITS(KEY_MAX)] = {0};
+	struct input_absinfo absinfo;
+	struct input_event* events = common->wcmEvents;
+	const WacomEventMap* map;
+	int64_t now = wcmGetTimeInMicros();
+	int channel, code, tool, down, handler, owned, n;
+
+	#define RESYNC_EVENT(t, c, v) do { \
+		events[n].time.tv_sec = now / 1000000; \
+		events[n].time.tv_usec = now % 1000000; \
+		events[n].type = (t); \
+		events[n].code = (c); \
+		events[n].value = (v); \
+		++n; \
+		} while (0)
+
+	if (ioctl(common->fd, EVIOCGKEY(sizeof(keys)), keys) < 0)
+	{
+		if (wcmReaderThread)
+			common->wcmNotes[WCM_NOTE_RESYNC]++;
+		else
+			xf86Msg(X_ERROR, "%s: unable to resync key state: %s\n",
+				local->name, strerror(errno));
+		return;
+	}
+
+	for (channel = 0; channel < MAX_CHANNELS; channel++)
+	{
+		WacomDeviceState* ds = &common->wcmChannel[channel].work;
+
+		if (!ds->proximity && common->wcmProtocolLevel != 4)
+			continue;
+
+		tool = usbResyncTool(common, channel, keys, &down);
+		if (tool < 0)
+			continue;
+
+		if (ds->proximity)
+			common->wcmLastToolSerial = ds->serial_num;
+		else
+		{
+			/* a new tool, start as usbParseFrame would */
+			memset(&common->wcmChannel[channel], 0, sizeof(WacomChannel));
+			common->wcmLastToolSerial = channel ? 0xf0 : 0;
+		}
+
+		n = 0;
+		RESYNC_EVENT(EV_KEY, tool, down);
+
+		/* pads own the pad keys, strips and wheels, other tools the
+		 * remaining buttons and axes; touch only has its tool key */
+		handler = common->wcmKeyMap[tool].handler;
+		if (down && handler != USB_DECODE_TOUCH &&
+				handler != USB_DECODE_TOUCH2)
+		{
+			owned = (handler == USB_DECODE_PAD) ?
+				USB_DECODE_PADKEY : USB_DECODE_BUTTON;
+			for (code = 0; code <= KEY_MAX; code++)
+				if (common->wcmKeyMap[code].handler == owned &&
+						n < common->wcmEventMax - 1)
+					RESYNC_EVENT(EV_KEY, code,
+						ISBITSET(keys, code) ? 1 : 0);
+
+			owned = (handler == USB_DECODE_PAD) ?
+				(WCM_CHANGED_STRIP | WCM_CHANGED_WHEEL) :
+				~WCM_CHANGED_STRIP;
+			for (code = 0; code <= ABS_MAX; code++)
+			{
+				map = &common->wcmAbsMap[code];
+				if (map->handler == USB_DECODE_NONE ||
+						map->handler == USB_DECODE_MISC ||
+						!(map->changed & owned) ||
+						n >= common->wcmEventMax - 1)
+					continue;
+				if (ioctl(common->fd, EVIOCGABS(code), &absinfo) < 0)
+					continue;
+				RESYNC_EVENT(EV_ABS, code, absinfo.value);
+			}
+		}
+		RESYNC_EVENT(EV_SYN, SYN_REPORT, 0);
+
+		DBG(1, common, "resyncing channel %d with %d events\n",
+			channel, n);
+		usbParseChannel(local, channel, events, n);
+	}
+
+	common->wcmLastToolSerial = 0;
+	#undef RESYNC_EVENT
+}
 /* vim: set noexpandtab shiftwidth=8: */
@@ -466,6 +466,51 @@ int wcmParseOptions(LocalDevicePtr local, unsigned long* keys)
 			common->wcmSuppress = DEFAULT_SUPPRESS;
 	}
 
+	common->wcmReadBudget = xf86SetIntOption(local->options, "ReadBudget",
+			common->wcmReadBudget);
+	if (common->wcmReadBudget < 1)
+	{
+		xf86Msg(X_CONFIG, "%s: ReadBudget invalid %d, using %d\n",
+			local->name, common->wcmReadBudget, DEFAULT_READ_BUDGET);
+		common->wcmReadBudget = DEFAULT_READ_BUDGET;
+	}
+
+	common->wcmThreaded = xf86SetBoolOption(local->options, "Thread",
+			common->wcmThreaded);
+	common->wcmShared = xf86SetBoolOption(local->options, "SharedReader",
+			common->wcmShared);
+
+	common->wcmOverloadThreshold = xf86SetIntOption(local->options,
+			"OverloadThreshold", common->wcmOverloadThreshold);
+	if (common->wcmOverloadThreshold < 0)
+	{
+		xf86Msg(X_CONFIG, "%s: OverloadThreshold invalid %d, not coalescing\n",
+			local->name, common->wcmOverloadThreshold);
+		common->wcmOverloadThreshold = 0;
+	}
+
+	common->wcmHoverRate = xf86SetIntOption(local->options, "HoverRate",
+			common->wcmHoverRate);
+	if (common->wcmHoverRate < 0 || common->wcmHoverRate > MAX_EVENT_RATE)
+	{
+		xf86Msg(X_CONFIG, "%s: HoverRate invalid %d, not decimating\n",
+			local->name, common->wcmHoverRate);
+		common->wcmHoverRate = 0;
+	}
+
+	common->wcmTiming = xf86SetBoolOption(local->options,
+			"PipelineLatency", common->wcmTiming);
+
+	/* the common may be shared, the last device to set it wins */
+	s = xf86SetStrOption(local->options, "RecordFile",
+			common->wcmRecordFile);
+	xfree(common->wcmRecordFile);
+	common->wcmRecordFile = s;
+	s = xf86SetStrOption(local->options, "TraceFile",
+			common->wcmTraceFile);
+	xfree(common->wcmTraceFile);
+	common->wcmTraceFile = s;
+
 	if (xf86SetBoolOption(local->options, "Tilt",
 			(common->wcmFlags & TILT_REQUEST_FLAG)))
 	{
@@ -540,6 +585,14 @@ int wcmParseOptions(LocalDevicePtr local, unsigned long* keys)
 	priv->bottomY = xf86SetIntOption(local->options, "BottomY", 0);
 	priv->serial = xf86SetIntOption(local->options, "Serial", 0);
 
+	priv->maxEventRate = xf86SetIntOption(local->options, "MaxEventRate", 0);
+	if (priv->maxEventRate < 0 || priv->maxEventRate > MAX_EVENT_RATE)
+	{
+		xf86Msg(X_CONFIG, "%s: MaxEventRate invalid %d, not limiting\n",
+			local->name, priv->maxEventRate);
+		priv->maxEventRate = 0;
+	}
+
 	tool = priv->tool;
 	area = priv->toolarea;
 	area->topX = priv->topX;
@@ -35,6 +35,7 @@ void xf86WcmChangeScreen(LocalDevicePtr local, int value);
 #if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 3
 	int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, 
 		XIPropertyValuePtr prop, BOOL checkonly);
+	int xf86WcmGetProperty(DeviceIntPtr dev, Atom property);
 	void InitWcmDeviceProperties(LocalDevicePtr local);
 #endif
 
@@ -158,10 +159,14 @@ Atom prop_threshold;
 Atom prop_suppress;
 Atom prop_touch;
 Atom prop_hover;
+Atom prop_event_rate;
 Atom prop_tooltype;
 Atom prop_btnactions;
+Atom prop_latency;
+Atom prop_statistics;
 #ifdef DEBUG
 Atom prop_debuglevels;
+Atom prop_trace;
 #endif
 
 /* Special case: format -32 means type is XA_ATOM */
@@ -206,6 +211,76 @@ static Atom InitWcmAtom(DeviceIntPtr dev, char *name, int format, int nvalues, i
 	return atom;
 }
 
+/* set while the driver itself updates a read-only property */
+static Bool wcmPropertyUpdate;
+
+/* copy the stage histograms of the tablet into the latency property */
+static int wcmUpdateLatency(DeviceIntPtr dev, WacomCommonPtr common)
+{
+	CARD32 values[WCM_STAGES * WCM_LATENCY_BUCKETS];
+	WacomStageTime stages[WCM_STAGES];
+	int i, j, rc;
+
+	wcmStageSum(common, stages);
+	for (i = 0; i < WCM_STAGES; i++)
+		for (j = 0; j < WCM_LATENCY_BUCKETS; j++)
+			values[i * WCM_LATENCY_BUCKETS + j] =
+				stages[i].hist[j];
+
+	wcmPropertyUpdate = TRUE;
+	rc = XIChangeDeviceProperty(dev, prop_latency, XA_INTEGER, 32,
+			PropModeReplace, ARRAY_SIZE(values), values, FALSE);
+	wcmPropertyUpdate = FALSE;
+	return rc;
+}
+
+/* copy the counters of the tablet and the device into the statistics */
+static int wcmUpdateStatistics(DeviceIntPtr dev, WacomDevicePtr priv)
+{
+	WacomCommonPtr common = priv->common;
+	CARD32 values[WCM_STATS + WCM_POSTED];
+	int i, rc;
+
+	for (i = 0; i < WCM_STATS; i++)
+		values[i] = common->wcmStats[i] - common->wcmStatsBase[i];
+	for (i = 0; i < WCM_POSTED; i++)
+		values[WCM_STATS + i] = priv->posted[i];
+
+	wcmPropertyUpdate = TRUE;
+	rc = XIChangeDeviceProperty(dev, prop_statistics, XA_INTEGER, 32,
+			PropModeReplace, ARRAY_SIZE(values), values, FALSE);
+	wcmPropertyUpdate = FALSE;
+	return rc;
+}
+
+#ifdef DEBUG
+/* the trace level is shared by all devices, a dump reads back as 0 */
+static int wcmUpdateTrace(DeviceIntPtr dev)
+{
+	CARD8 values[2];
+	int rc;
+
+	values[0] = wcmTraceLevel;
+	values[1] = 0;
+
+	wcmPropertyUpdate = TRUE;
+	rc = XIChangeDeviceProperty(dev, prop_trace, XA_INTEGER, 8,
+			PropModeReplace, 2, values, FALSE);
+	wcmPropertyUpdate = FALSE;
+	return rc;
+}
+#endif
+
+static void wcmResetStatistics(WacomCommonPtr common)
+{
+	WacomDevicePtr priv;
+
+	memcpy(common->wcmStatsBase, common->wcmStats,
+		sizeof(common->wcmStatsBase));
+	for (priv = common->wcmDevices; priv; priv = priv->next)
+		memset(priv->posted, 0, sizeof(priv->posted));
+}
+
 void InitWcmDeviceProperties(LocalDevicePtr local)
 {
 	WacomDevicePtr priv = (WacomDevicePtr) local->private;
@@ -284,6 +359,9 @@ void InitWcmDeviceProperties(LocalDevicePtr local)
 	values[0] = !common->wcmTPCButton;
 	prop_hover = InitWcmAtom(local->dev, WACOM_PROP_HOVER, 8, 1, values);
 
+	values[0] = priv->maxEventRate;
+	prop_event_rate = InitWcmAtom(local->dev, WACOM_PROP_EVENT_RATE, 32, 1, values);
+
 
 	values[0] = MakeAtom(local->type_name, strlen(local->type_name), TRUE);
 	prop_tooltype = InitWcmAtom(local->dev, WACOM_PROP_TOOL_TYPE, -32, 1, values);
@@ -292,15 +370,29 @@ void InitWcmDeviceProperties(LocalDevicePtr local)
 	memset(values, 0, sizeof(values));
 	prop_btnactions = InitWcmAtom(local->dev, WACOM_PROP_BUTTON_ACTIONS, -32, WCM_MAX_MOUSE_BUTTONS, values);
 
+	prop_latency = MakeAtom(WACOM_PROP_PIPELINE_LATENCY,
+			strlen(WACOM_PROP_PIPELINE_LATENCY), TRUE);
+	wcmUpdateLatency(local->dev, common);
+	XISetDevicePropertyDeletable(local->dev, prop_latency, FALSE);
+
+	prop_statistics = MakeAtom(WACOM_PROP_STATISTICS,
+			strlen(WACOM_PROP_STATISTICS), TRUE);
+	wcmUpdateStatistics(local->dev, priv);
+	XISetDevicePropertyDeletable(local->dev, prop_statistics, FALSE);
+
 #ifdef DEBUG
 	values[0] = priv->debugLevel;
 	values[1] = common->debugLevel;
 	prop_debuglevels = InitWcmAtom(local->dev, WACOM_PROP_DEBUGLEVELS, 8, 2, values);
+
+	values[0] = wcmTraceLevel;
+	values[1] = 0;
+	prop_trace = InitWcmAtom(local->dev, WACOM_PROP_DEBUG_TRACE, 8, 2, values);
 #endif
 }
 
-int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
-		BOOL checkonly)
+static int wcmSetProperty(DeviceIntPtr dev, Atom property,
+		XIPropertyValuePtr prop, BOOL checkonly)
 {
 	LocalDevicePtr local = (LocalDevicePtr) dev->public.devicePrivate;
 	WacomDevicePtr priv = (WacomDevicePtr) local->private;
@@ -411,6 +503,40 @@ int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
 	} else if (property == prop_serials)
 	{
 		return BadValue; /* Read-only */
+	} else if (property == prop_latency)
+	{
+		CARD32 value;
+
+		if (wcmPropertyUpdate)
+			return Success;
+
+		/* all a client can do is turn the timing on or off */
+		if (prop->size != 1 || prop->format != 32)
+			return BadMatch;
+		value = *(CARD32*)prop->data;
+		if (value > 1)
+			return BadValue;
+
+		if (!checkonly)
+		{
+			if (!value)
+				memset(common->wcmStages, 0,
+					sizeof(common->wcmStages));
+			common->wcmTiming = value;
+		}
+	} else if (property == prop_statistics)
+	{
+		if (wcmPropertyUpdate)
+			return Success;
+
+		/* all a client can do is reset them */
+		if (prop->size != 1 || prop->format != 32)
+			return BadMatch;
+		if (*(CARD32*)prop->data != 0)
+			return BadValue;
+
+		if (!checkonly)
+			wcmResetStatistics(common);
 	} else if (property == prop_strip_buttons)
 	{
 		CARD8 *values;
@@ -563,7 +689,18 @@ int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
 			return BadValue;
 
 		if (!checkonly && common->wcmTouch != values[0])
+		{
+			/* gestures post events while filtering, which the
+			 * reader thread must not do */
+			if (values[0] && common->wcmGesture && common->wcmThread)
+			{
+				xf86Msg(X_WARNING, "%s: touch gestures need the "
+					"device read in the server, stopping "
+					"the reader thread\n", local->name);
+				wcmThreadCancel(common);
+			}
 			common->wcmTouch = values[0];
+		}
 	} else if (property == prop_hover)
 	{
 		CARD8 *values = (CARD8*)prop->data;
@@ -576,6 +713,20 @@ int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
 
 		if (!checkonly && common->wcmTPCButton != !values[0])
 			common->wcmTPCButton = !values[0];
+	} else if (property == prop_event_rate)
+	{
+		CARD32 value;
+
+		if (prop->size != 1 || prop->format != 32)
+			return BadValue;
+
+		value = *(CARD32*)prop->data;
+
+		if (value > MAX_EVENT_RATE)
+			return BadValue;
+
+		if (!checkonly)
+			priv->maxEventRate = value;
 	} else if (property == prop_tv_resolutions)
 	{
 		CARD32 *values;
@@ -619,6 +770,34 @@ int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
 			priv->debugLevel = values[0];
 			common->debugLevel = values[1];
 		}
+	} else if (property == prop_trace)
+	{
+		CARD8 *values;
+
+		if (wcmPropertyUpdate)
+			return Success;
+
+		if (prop->size != 2 || prop->format != 8)
+			return BadMatch;
+
+		values = (CARD8*)prop->data;
+		if (values[0] > 12 || values[1] > 1)
+			return BadValue;
+		if (values[1] && !common->wcmTraceFile)
+			return BadValue;
+
+		if (!checkonly)
+		{
+			if (!wcmTraceSetLevel(values[0]))
+				return BadAlloc;
+			if (values[1] && wcmTraceDump(common->wcmTraceFile))
+			{
+				xf86Msg(X_ERROR, "%s: unable to write the "
+					"trace to %s: %s\n", local->name,
+					common->wcmTraceFile, strerror(errno));
+				return BadAlloc;
+			}
+		}
 #endif
 	} else if (property == prop_btnactions)
 	{
@@ -729,5 +908,39 @@ int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
 
 	return Success;
 }
+
+int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
+		BOOL checkonly)
+{
+	LocalDevicePtr local = (LocalDevicePtr) dev->public.devicePrivate;
+	WacomDevicePtr priv = (WacomDevicePtr) local->private;
+	int rc;
+
+	if (checkonly)
+		return wcmSetProperty(dev, property, prop, checkonly);
+
+	/* the reader thread uses much of what is changed here */
+	wcmThreadPause(priv->common);
+	rc = wcmSetProperty(dev, property, prop, checkonly);
+	wcmThreadResume(priv->common);
+	return rc;
+}
+
+int xf86WcmGetProperty(DeviceIntPtr dev, Atom property)
+{
+	LocalDevicePtr local = (LocalDevicePtr) dev->public.devicePrivate;
+	WacomDevicePtr priv = (WacomDevicePtr) local->private;
+
+	if (property == prop_latency)
+		return wcmUpdateLatency(dev, priv->common);
+	else if (property == prop_statistics)
+		return wcmUpdateStatistics(dev, priv);
+#ifdef DEBUG
+	else if (property == prop_trace)
+		return wcmUpdateTrace(dev);
+#endif
+
+	return Success;
+}
 #endif /* GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 3 */
 /* vim: set noexpandtab shiftwidth=8: */
@@ -42,6 +42,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <linux/serial.h>
+#include <time.h>
 
 #include "xf86Wacom.h"
 
@@ -59,6 +60,7 @@ Bool wcmIsWacomDevice (char* fname);
     extern void InitWcmDeviceProperties(LocalDevicePtr local);
     extern int xf86WcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
                 BOOL checkonly);
+    extern int xf86WcmGetProperty(DeviceIntPtr dev, Atom property);
 #endif
 
 extern int xf86WcmDevSwitchMode(ClientPtr client, DeviceIntPtr dev, int mode);
@@ -67,7 +69,6 @@ extern void wcmInitialScreens(LocalDevicePtr local);
 extern void xf86WcmInitialCoordinates(LocalDevicePtr local, int axes);
 
 static int xf86WcmDevOpen(DeviceIntPtr pWcm);
-static int xf86WcmReady(LocalDevicePtr local);
 static void xf86WcmDevReadInput(LocalDevicePtr local);
 static void xf86WcmDevControlProc(DeviceIntPtr device, PtrCtrl* ctrl);
 int xf86WcmDevChangeControl(LocalDevicePtr local, xDeviceCtl * control);
@@ -881,7 +882,8 @@ static int xf86WcmRegisterX11Devices (LocalDevicePtr local)
 
 #if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 3
 	InitWcmDeviceProperties(local);
-	XIRegisterPropertyHandler(local->dev, xf86WcmSetProperty, NULL, NULL);
+	XIRegisterPropertyHandler(local->dev, xf86WcmSetProperty,
+			xf86WcmGetProperty, NULL);
 #endif
 
 	return TRUE;
@@ -1007,6 +1009,16 @@ static Bool xf86WcmOpen(LocalDevicePtr local)
 		local->fd = -1;
 		return !Success;
 	}
+
+	/* from now on the device is drained until EAGAIN on each wakeup */
+	if (fcntl(local->fd, F_SETFL, fcntl(local->fd, F_GETFL) | O_NONBLOCK) == -1)
+	{
+		xf86Msg(X_ERROR, "%s: Cannot set %s non-blocking (%s)\n",
+			local->name, common->wcmDevice, strerror(errno));
+		xf86CloseSerial(local->fd);
+		local->fd = -1;
+		return !Success;
+	}
 	return Success;
 }
 
@@ -1064,6 +1076,8 @@ static int xf86WcmDevOpen(DeviceIntPtr pWcm)
 			common->min_maj = st.st_rdev;
 		common->fd = local->fd;
 		common->fd_refs = 1;
+		if (common->wcmRecordFile)
+			wcmRecordStart(local);
 	}
 
 	/* Grab the common descriptor, if it's available */
@@ -1079,137 +1093,305 @@ static int xf86WcmDevOpen(DeviceIntPtr pWcm)
 	return TRUE;
 }
 
-static int xf86WcmReady(LocalDevicePtr local)
-{
-#ifdef DEBUG
-	WacomDevicePtr priv = (WacomDevicePtr)local->private;
-#endif
-	int n = xf86WaitForInput(local->fd, 0);
-	DBG(10, priv, "%d numbers of data\n", n);
-
-	if (n >= 0) return n ? 1 : 0;
-	xf86Msg(X_ERROR, "%s: select error: %s\n", local->name, strerror(errno));
-	return 0;
-}
-
 /*****************************************************************************
  * xf86WcmDevReadInput --
- *   Read the device on IO signal
+ *   Read the device on IO signal. The descriptor is non-blocking, so we
+ *   keep reading until the device runs dry or the read budget is used up.
  ****************************************************************************/
 
 static void xf86WcmDevReadInput(LocalDevicePtr local)
 {
-	int loop=0;
-	#define MAX_READ_LOOPS 10
+	int loop=0, len;
 
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
 	WacomCommonPtr common = priv->common;
 
 	/* move data until we exhaust the device */
-	for (loop=0; loop < MAX_READ_LOOPS; ++loop)
+	for (loop=0; loop < common->wcmReadBudget; ++loop)
 	{
-		/* verify that there is still data in pipe */
-		if (!xf86WcmReady(local)) break;
-
-		/* dispatch */
-		common->wcmDevCls->Read(local);
+		/* dispatch; stop once nothing is pending (EAGAIN) or on error */
+		len = common->wcmDevCls->Read(local);
+		if (len < 0)
+		{
+			xf86Msg(X_ERROR, "%s: Error reading wacom device : %s\n", local->name, strerror(errno));
+			wcmDeviceLost(common);
+			return;
+		}
+		if (!len) break;
 	}
+	wcmFlushCoalesced(common);
 
 	/* report how well we're doing */
-	if (loop >= MAX_READ_LOOPS)
-		DBG(1, priv, "Can't keep up!!!\n");
+	if (loop >= common->wcmReadBudget)
+	{
+		common->wcmReadBudgetHits++;
+		DBG(1, priv, "Can't keep up!!! (%u wakeups over budget)\n",
+			common->wcmReadBudgetHits);
+	}
 	else if (loop > 0)
 		DBG(10, priv, "Read (%d)\n",loop);
-}					
+}
+
+/*****************************************************************************
+ * wcmDeviceLost --
+ *   Close all devices of a tablet that can't be read anymore.
+ ****************************************************************************/
+
+void wcmDeviceLost(WacomCommonPtr common)
+{
+	WacomDevicePtr wDev = common->wcmDevices;
+
+	/* In case of error, we assume the device has been
+	 * disconnected. So we close it and iterate over all
+	 * wcmDevices to actually close associated devices. */
+	for(; wDev; wDev = wDev->next)
+	{
+		if (wDev->local->fd >= 0)
+			xf86WcmDevProc(wDev->local->dev, DEVICE_OFF);
+	}
+}
 
-void wcmReadPacket(LocalDevicePtr local)
+/*****************************************************************************
+ * wcmDeviceLostLater, wcmDeviceLostCancel --
+ *   Run wcmDeviceLost from a work procedure, for readers that find out
+ *   in an input handler. The devices may be removed before it runs, so
+ *   the work procedure only gets a slot pointing to the common part,
+ *   which wcmDeviceLostCancel clears before the common part is freed.
+ ****************************************************************************/
+
+static Bool wcmDeviceLostProc(ClientPtr client, pointer data)
+{
+	WacomCommonPtr* slot = data;
+	WacomCommonPtr common = *slot;
+
+	if (common)
+	{
+		common->wcmLostPending = NULL;
+		wcmDeviceLost(common);
+	}
+	xfree(slot);
+	return TRUE;
+}
+
+void wcmDeviceLostLater(WacomCommonPtr common)
+{
+	WacomCommonPtr* slot;
+
+	if (common->wcmLostPending)
+		return;
+
+	slot = xalloc(sizeof(WacomCommonPtr));
+	if (!slot)
+		return;
+	*slot = common;
+	common->wcmLostPending = slot;
+	QueueWorkProc(wcmDeviceLostProc, NULL, slot);
+}
+
+void wcmDeviceLostCancel(WacomCommonPtr common)
+{
+	if (common->wcmLostPending)
+	{
+		*common->wcmLostPending = NULL;
+		common->wcmLostPending = NULL;
+	}
+}
+
+/*****************************************************************************
+ * wcmReadPacket --
+ *   Read one chunk of data and hand all whole packets to the parser.
+ *   Returns the number of bytes read, 0 if no data was pending, -1 if
+ *   the device went away. Called from the reader thread in threaded mode,
+ *   so the caller deals with errors.
+ ****************************************************************************/
+
+int wcmReadPacket(LocalDevicePtr local)
 {
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
 	WacomCommonPtr common = priv->common;
-	int len, pos, cnt, remaining;
-	unsigned char * data;
+	WacomRingPtr ring = &common->wcmRing;
+	WacomStageMark mark;
+	int len, cnt, remaining, room, avail;
+	const unsigned char * data;
+	unsigned char * space;
 
-	DBG(10, common, "fd=%d\n", local->fd);
+	DBG(10, common, "fd=%d\n", common->fd);
 
-	remaining = sizeof(common->buffer) - common->bufpos;
+	space = wcmRingWriteSpace(ring, &remaining);
+	if (!remaining)
+	{
+		/* the parser couldn't make sense of a full buffer, drop it */
+		DBG(1, common, "buffer full, dropping %d bytes\n",
+			wcmRingAvailable(ring));
+		wcmRingConsume(ring, wcmRingAvailable(ring));
+		space = wcmRingWriteSpace(ring, &remaining);
+	}
 
-	DBG(1, common, "pos=%d"
-		" remaining=%d\n", common->bufpos, remaining);
+	DBG(1, common, "pending=%d"
+		" remaining=%d\n", wcmRingAvailable(ring), remaining);
+	room = ring->size - wcmRingAvailable(ring);
 
 	/* fill buffer with as much data as we can handle */
-	len = xf86ReadSerial(local->fd,
-		common->buffer + common->bufpos, remaining);
+	wcmStageEnter(common, &mark);
+	len = xf86ReadSerial(common->fd, space, remaining);
+	wcmStageLeave(common, WCM_STAGE_READ, &mark);
+
+	if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
 
 	if (len <= 0)
 	{
-		/* In case of error, we assume the device has been
-		 * disconnected. So we close it and iterate over all
-		 * wcmDevices to actually close associated devices. */
-		WacomDevicePtr wDev = common->wcmDevices;
-		for(; wDev; wDev = wDev->next)
-		{
-			if (wDev->local->fd >= 0)
-				xf86WcmDevProc(wDev->local->dev, DEVICE_OFF);
-		}
-		xf86Msg(X_ERROR, "%s: Error reading wacom device : %s\n", local->name, strerror(errno));
-		return;
+		if (!len)
+			errno = ENODEV;
+		return -1;
 	}
+	common->wcmStats[WCM_STAT_BYTES] += len;
+
+	/* a read that fills the buffer leaves more behind in the kernel;
+	 * after a few of them in a row motion gets coalesced. One that
+	 * only fills the space up to the end of the ring tells nothing. */
+	if (len < remaining)
+		common->wcmFullReads = 0;
+	else if (len == room &&
+			++common->wcmFullReads == common->wcmOverloadThreshold)
+		DBG(1, common, "behind on reading, coalescing motion\n");
+	common->wcmOverload = common->wcmOverloadThreshold &&
+		common->wcmFullReads >= common->wcmOverloadThreshold;
 
 	/* account for new data */
-	common->bufpos += len;
+	common->wcmRecvTime = wcmGetTimeInMicros();
+	if (common->wcmRecorder)
+		wcmRecordData(common, space, len);
+	wcmRingCommit(ring, len);
 	DBG(10, common, "buffer has %d bytes\n",
-		common->bufpos);
-
-	pos = 0;
+		wcmRingAvailable(ring));
 
-	/* while there are whole packets present, check the packet length
-	 * for serial ISDv4 packet since it's different for pen and touch
-	 */
-	if (common->wcmForceDevice == DEVICE_ISDV4 && common->wcmDevCls != &gWacomUSBDevice) 
+	/* parse packets in place for as long as the parser takes them;
+	 * it knows best how long the next one is */
+	while (wcmRingAvailable(ring))
 	{
-		data = common->buffer;
-		/* choose wcmPktLength if it is not an out-prox event */
-		if (data[0])
-			common->wcmPktLength = WACOM_PKGLEN_TPCPEN;
+		data = wcmRingPeek(ring, &avail);
 
-		if ( data[0] & 0x10 )
+		/* parse packet */
+		wcmStageEnter(common, &mark);
+		cnt = common->wcmModel->Parse(local, data, avail);
+		wcmStageLeave(common, WCM_STAGE_PARSE, &mark);
+		if (!cnt)
 		{
-			/* set touch PktLength */
-			common->wcmPktLength = WACOM_PKGLEN_TOUCH93;
-			if ((common->tablet_id == 0x9A) || (common->tablet_id == 0x9F))
-				common->wcmPktLength = WACOM_PKGLEN_TOUCH9A;
-			if ((common->tablet_id == 0xE2) || (common->tablet_id == 0xE3))
-				common->wcmPktLength = WACOM_PKGLEN_TOUCH2FG;
+			/* half a packet remains, wait for the rest */
+			DBG(7, common, "KEEP %d bytes\n", wcmRingAvailable(ring));
+			break;
 		}
-	}
-
-	while ((common->bufpos - pos) >=  common->wcmPktLength)
-	{
-		/* parse packet */
-		cnt = common->wcmModel->Parse(local, common->buffer + pos);
-		if (cnt <= 0)
+		if (cnt < 0 || cnt > avail)
 		{
 			DBG(1, common, "Misbehaving parser returned %d\n",cnt);
+			common->wcmStats[WCM_STAT_PARSER]++;
 			break;
 		}
-		pos += cnt;
+		common->wcmStats[WCM_STAT_FRAMES]++;
+		wcmRingConsume(ring, cnt);
 	}
- 
-	if (pos)
+
+	return len;
+}
+
+/*****************************************************************************
+ * wcmGetTimeInMicros --
+ *   Current CLOCK_MONOTONIC time in microseconds, the clock device states
+ *   are stamped with.
+ ****************************************************************************/
+
+int64_t wcmGetTimeInMicros(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return (int64_t)GetTimeInMillis() * 1000;
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*****************************************************************************
+ * wcmStageEnter, wcmStageLeave --
+ *   Time a stage of the pipeline, if the tablet is being timed. Stages
+ *   nest, parsing calls wcmEvent and so on down to posting, and a stage is
+ *   only charged for the time not spent in the stages it called; the time
+ *   of those is summed up per thread. The reader thread and the server
+ *   run stages at once, each has its own wcmStages. CLOCK_MONOTONIC_RAW
+ *   is read rather than the clock of the device states, these are
+ *   durations only.
+ ****************************************************************************/
+
+static __thread int64_t wcmStageNested;
+
+static int64_t wcmStageClock(void)
+{
+	struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void wcmStageEnter(WacomCommonPtr common, WacomStageMark* mark)
+{
+	/* a stage that started untimed stays so */
+	if (!common->wcmTiming)
 	{
-		/* if half a packet remains, move it down */
-		if (pos < common->bufpos)
-		{
-			DBG(7, common, "MOVE %d bytes\n", common->bufpos - pos);
-			memmove(common->buffer,common->buffer+pos,
-				common->bufpos-pos);
-			common->bufpos -= pos;
-		}
+		mark->start = 0;
+		return;
+	}
 
-		/* otherwise, reset the buffer for next time */
-		else
+	mark->nested = wcmStageNested;
+	wcmStageNested = 0;
+	mark->start = wcmStageClock();
+}
+
+void wcmStageLeave(WacomCommonPtr common, int stage, WacomStageMark* mark)
+{
+	WacomStageTime* st = &common->wcmStages[wcmReaderThread][stage];
+	int64_t elapsed, us;
+	int bucket = 0;
+
+	if (!mark->start)
+		return;
+
+	elapsed = wcmStageClock() - mark->start;
+	us = (elapsed - wcmStageNested) / 1000;
+	while (us > 0 && bucket < WCM_LATENCY_BUCKETS - 1)
+	{
+		us >>= 1;
+		bucket++;
+	}
+
+	st->count++;
+	st->ns += elapsed - wcmStageNested;
+	st->hist[bucket]++;
+	wcmStageNested = mark->nested + elapsed;
+}
+
+/*****************************************************************************
+ * wcmStageSum --
+ *   The stage times of the server and the reader thread, added up.
+ ****************************************************************************/
+
+void wcmStageSum(WacomCommonPtr common, WacomStageTime* stages)
+{
+	int i, j, t;
+
+	memset(stages, 0, WCM_STAGES * sizeof(WacomStageTime));
+	for (t = 0; t < 2; t++)
+	{
+		for (i = 0; i < WCM_STAGES; i++)
 		{
-			common->bufpos = 0;
+			const WacomStageTime* st = &common->wcmStages[t][i];
+
+			stages[i].count += st->count;
+			stages[i].ns += st->ns;
+			for (j = 0; j < WCM_LATENCY_BUCKETS; j++)
+				stages[i].hist[j] += st->hist[j];
 		}
 	}
 }
@@ -1255,6 +1437,28 @@ static void xf86WcmDevClose(LocalDevicePtr local)
 		if (!--common->fd_refs)
 		{
 			DBG(1, common, "Closing device; uninitializing.\n");
+			if (common->wcmReadBudgetHits)
+				xf86Msg(X_INFO, "%s: read budget of %d exhausted "
+					"on %u wakeups\n", local->name,
+					common->wcmReadBudget,
+					common->wcmReadBudgetHits);
+			if (common->wcmStats[WCM_STAT_SYN_DROPPED])
+				xf86Msg(X_INFO, "%s: kernel dropped events "
+					"%u times\n", local->name,
+					common->wcmStats[WCM_STAT_SYN_DROPPED]);
+			if (common->wcmQueueStalls || common->wcmQueueOverflows)
+				xf86Msg(X_INFO, "%s: reader thread waited %u "
+					"times, dropped %u states\n", local->name,
+					common->wcmQueueStalls,
+					common->wcmQueueOverflows);
+			if (common->wcmCoalesced)
+				xf86Msg(X_INFO, "%s: coalesced %u motion states "
+					"while behind\n", local->name,
+					common->wcmCoalesced);
+			if (common->wcmHoverDecimated)
+				xf86Msg(X_INFO, "%s: decimated %u hover states\n",
+					local->name, common->wcmHoverDecimated);
+			wcmRecordStop(common);
 			xf86CloseSerial (common->fd);
 		}
 	}
@@ -1269,6 +1473,7 @@ static int xf86WcmDevProc(DeviceIntPtr pWcm, int what)
 {
 	LocalDevicePtr local = (LocalDevicePtr)pWcm->public.devicePrivate;
 	WacomDevicePtr priv = (WacomDevicePtr)local->private;
+	WacomCommonPtr common = priv->common;
 
 	DBG(2, priv, "BEGIN dev=%p priv=%p "
 			"type=%s flags=%d fd=%d what=%s\n",
@@ -1306,7 +1511,12 @@ static int xf86WcmDevProc(DeviceIntPtr pWcm, int what)
 				return !Success;
 			}
 			priv->wcmDevOpenCount++;
-			xf86AddEnabledDevice(local);
+			if ((!common->wcmThreaded || wcmThreadStart(local) != Success) &&
+				(!common->wcmShared || wcmReactorAdd(local) != Success))
+				xf86AddEnabledDevice(local);
+			if (!pWcm->public.on)
+				RegisterBlockAndWakeupHandlers(wcmHeldBlockHandler,
+					(WakeupHandlerProcPtr)NoopDDA, local);
 			pWcm->public.on = TRUE;
 			break;
 
@@ -1314,9 +1524,20 @@ static int xf86WcmDevProc(DeviceIntPtr pWcm, int what)
 		case DEVICE_CLOSE:
 			if (local->fd >= 0)
 			{
-				xf86RemoveEnabledDevice(local);
+				if (common->wcmThreaded)
+					wcmThreadStop(local);
+				else if (common->wcmShared)
+					wcmReactorRemove(local);
+				else
+					xf86RemoveEnabledDevice(local);
 				xf86WcmDevClose(local);
 			}
+			if (pWcm->public.on)
+				RemoveBlockAndWakeupHandlers(wcmHeldBlockHandler,
+					(WakeupHandlerProcPtr)NoopDDA, local);
+			priv->eventHeld = 0;
+			priv->eventArmed = 0;
+			TimerCancel(priv->eventTimer);
 			pWcm->public.on = FALSE;
 			priv->wcmDevOpenCount = 0;
 			break;
@@ -74,9 +74,26 @@
 #endif
 
 #if DEBUG
+/* DBG sites above this level compile to nothing, see --with-debug-level */
+#ifndef DEBUG_MAX_LEVEL
+#define DEBUG_MAX_LEVEL 12
+#endif
+
+extern int wcmTraceLevel;
+void wcmTrace(const char* name, const char* func, int level,
+	const char* format, ...);
+
+/* DBG sites up to wcmTraceLevel are recorded in the trace ring as well,
+ * see wcmTrace.c. The reader thread only records them, the server log
+ * isn't safe to write from it. */
 #define DBG(lvl, priv, ...) \
 	do { \
-		if ((lvl) <= priv->debugLevel) { \
+		if ((lvl) > DEBUG_MAX_LEVEL) \
+			break; \
+		if ((lvl) <= wcmTraceLevel) \
+			wcmTrace(((WacomDeviceRec*)priv)->name, __func__, \
+				lvl, __VA_ARGS__); \
+		if ((lvl) <= priv->debugLevel && !wcmReaderThread) { \
 			xf86Msg(X_INFO, "%s (%s): ", \
 				((WacomDeviceRec*)priv)->name, __func__); \
 			xf86Msg(X_NONE, __VA_ARGS__); \
@@ -159,13 +176,52 @@ char *wcmEventAutoDevProbe (LocalDevicePtr local);
 int xf86WcmInitTablet(LocalDevicePtr local, const char* id, float version);
 
 /* standard packet handler */
-void wcmReadPacket(LocalDevicePtr local);
+int wcmReadPacket(LocalDevicePtr local);
+int64_t wcmGetTimeInMicros(void);
+
+/* time spent in each stage of the pipeline, see WCM_STAGE_* */
+void wcmStageEnter(WacomCommonPtr common, WacomStageMark* mark);
+void wcmStageLeave(WacomCommonPtr common, int stage, WacomStageMark* mark);
+void wcmStageSum(WacomCommonPtr common, WacomStageTime* stages);
+void wcmDeviceLost(WacomCommonPtr common);
+void wcmDeviceLostLater(WacomCommonPtr common);
+void wcmDeviceLostCancel(WacomCommonPtr common);
 
 /* handles suppression, filtering, and dispatch. */
 void wcmEvent(WacomCommonPtr common, unsigned int channel, const WacomDeviceState* ds);
+void commonDispatchDevice(WacomCommonPtr common, unsigned int channel,
+	WacomDeviceState* ds, int suppress);
+void wcmFlushCoalesced(WacomCommonPtr common);
+
+/* threaded mode, reads and filters in a thread, dispatches in the server */
+extern __thread int wcmReaderThread; /* set in the reader thread */
+int wcmThreadStart(LocalDevicePtr local);
+void wcmThreadStop(LocalDevicePtr local);
+void wcmThreadCancel(WacomCommonPtr common);
+void wcmThreadPause(WacomCommonPtr common);
+void wcmThreadResume(WacomCommonPtr common);
+void wcmThreadQueue(WacomCommonPtr common, unsigned int channel,
+	const WacomDeviceState* ds, int suppress);
+
+/* shared reader, one epoll set for all tablets */
+int wcmReactorAdd(LocalDevicePtr local);
+void wcmReactorRemove(LocalDevicePtr local);
+
+/* recording of the raw device data, see wacom-record.h */
+void wcmRecordStart(LocalDevicePtr local);
+void wcmRecordData(WacomCommonPtr common, const unsigned char* data, int len);
+void wcmRecordStop(WacomCommonPtr common);
+
+#if DEBUG
+/* binary trace of DBG sites */
+int wcmTraceSetLevel(int level);
+void wcmTraceForget(const char* name);
+int wcmTraceDump(const char* path);
+#endif
 
 /* dispatches data to XInput event system */
 void xf86WcmSendEvents(LocalDevicePtr local, const WacomDeviceState* ds);
+void wcmHeldBlockHandler(pointer data, OSTimePtr pTimeout, pointer pReadmask);
 
 /* generic area check for xf86Wacom.c, wcmCommon.c and wcmXCommand.c */
 Bool wcmPointInArea(WacomToolAreaPtr area, int x, int y);
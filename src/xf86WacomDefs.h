@@ -25,14 +25,25 @@
  ****************************************************************************/
 #include <asm/types.h>
 #include <linux/input.h>
+#include <stdint.h>
+#include "wcmRingBuffer.h"
 #define MAX_USB_EVENTS 32
 #define WACOM_VENDOR_ID 0x056a  /* vendor ID on the kernel device */
 
 #define DEFAULT_SUPPRESS 2      /* default suppress */
 #define MAX_SUPPRESS 100        /* max value of suppress */
-#define BUFFER_SIZE 256         /* size of reception buffer */
+#define DEFAULT_READ_BUDGET 10  /* default max reads per wakeup */
+#define MAX_EVENT_RATE 1000     /* max value of MaxEventRate and HoverRate */
+#define BUFFER_SIZE 256         /* size of id/query buffers */
 #define MAXTRY 3                /* max number of try to receive magic number */
 
+/* reception buffer sizes; USB reads whole struct input_events, so its buffer
+ * is sized in events and large enough to hold several SYN_REPORT frames */
+#define USB_BUFFER_EVENTS 128
+#define USB_BUFFER_SIZE (USB_BUFFER_EVENTS * sizeof(struct input_event))
+#define ISDV4_BUFFER_SIZE 256
+#define RECV_BUFFER_SIZE USB_BUFFER_SIZE /* largest of the above */
+
 /* Default max distance to the tablet at which a proximity-out event is generated for
  * cursor device (e.g. mouse). 
  */
@@ -59,7 +70,7 @@
 #define OTHER_PROX      1
 
 /* to access kernel defined bits */
-#define BIT(x)		(1<<((x) & (BITS_PER_LONG - 1)))
+#define BIT(x)		(1UL<<((x) & (BITS_PER_LONG - 1)))
 #define BITS_PER_LONG	(sizeof(long) * 8)
 #define NBITS(x)	((((x)-1)/BITS_PER_LONG)+1)
 #define ISBITSET(x,y)	((x)[LONG(y)] & BIT(y))
@@ -79,6 +90,8 @@ typedef struct _WacomFilterState WacomFilterState, *WacomFilterStatePtr;
 typedef struct _WacomDeviceClass WacomDeviceClass, *WacomDeviceClassPtr;
 typedef struct _WacomTool WacomTool, *WacomToolPtr;
 typedef struct _WacomToolArea WacomToolArea, *WacomToolAreaPtr;
+typedef struct _WacomThread WacomThread, *WacomThreadPtr;
+typedef struct _WacomRecorder WacomRecorder, *WacomRecorderPtr;
 
 /******************************************************************************
  * WacomModel - model-specific device capabilities
@@ -96,12 +109,149 @@ struct _WacomModel
 	int (*EnableSuppress)(LocalDevicePtr local);
 	int (*SetLinkSpeed)(LocalDevicePtr local);
 	int (*Start)(LocalDevicePtr local);
-	int (*Parse)(LocalDevicePtr local, const unsigned char* data);
+	int (*Parse)(LocalDevicePtr local, const unsigned char* data, int len);
+	                /* len bytes are available at data; returns the number
+	                 * of bytes consumed, 0 if a whole packet isn't there yet */
 	int (*FilterRaw)(WacomCommonPtr common, WacomChannelPtr pChannel,
 		WacomDeviceStatePtr ds);
 	int (*DetectConfig)(LocalDevicePtr local);
 };
 
+/******************************************************************************
+ * Statistics, see the "Wacom Statistics" property
+ *****************************************************************************/
+
+#define WCM_STAT_BYTES       0  /* bytes read from the device */
+#define WCM_STAT_FRAMES      1  /* packets the parser took */
+#define WCM_STAT_SUPPRESSED  2  /* states dropped by wcmCheckSuppress */
+#define WCM_STAT_FILTERED    3  /* states dropped by the raw filter */
+#define WCM_STAT_FIRST       4  /* first USB states of a tool dropped */
+#define WCM_STAT_OVERFLOWS   5  /* frames too large for wcmEvents */
+#define WCM_STAT_SYN_DROPPED 6  /* SYN_DROPPED received */
+#define WCM_STAT_PARSER      7  /* reads the parser gave up on */
+#define WCM_STATS            8
+
+#define WCM_POSTED_MOTION    0  /* events posted by a device */
+#define WCM_POSTED_BUTTON    1
+#define WCM_POSTED_KEY       2
+#define WCM_POSTED_PROXIMITY 3
+#define WCM_POSTED           4
+
+/* what the reader thread ran into, logged by the server, see wcmThreadInput */
+#define WCM_NOTE_OVERFLOW    0  /* frame too large for wcmEvents */
+#define WCM_NOTE_SERIAL0     1  /* event from the invalid serial 0 */
+#define WCM_NOTE_REL         2  /* rel event other than the wheel */
+#define WCM_NOTE_SYN_REPORT  3  /* unexpected SYN_REPORT, mode changed */
+#define WCM_NOTE_RESYNC      4  /* key state resync failed */
+#define WCM_NOTE_MAGIC       5  /* ISDV4 packet cut short by a header */
+#define WCM_NOTES            6
+
+/******************************************************************************
+ * WacomDeviceState
+ *****************************************************************************/
+
+#define MAX_SAMPLES	20
+#define DEFAULT_SAMPLES 4
+
+#define PEN(ds)         ((((ds)->device_id) & 0x07ff) == 0x0022 || \
+                         (((ds)->device_id) & 0x07ff) == 0x0042 || \
+                         (((ds)->device_id) & 0x07ff) == 0x0052)
+#define STROKING_PEN(ds) ((((ds)->device_id) & 0x07ff) == 0x0032)
+#define AIRBRUSH(ds)    ((((ds)->device_id) & 0x07ff) == 0x0112)
+#define MOUSE_4D(ds)    ((((ds)->device_id) & 0x07ff) == 0x0094)
+#define MOUSE_2D(ds)    ((((ds)->device_id) & 0x07ff) == 0x0007)
+#define LENS_CURSOR(ds) ((((ds)->device_id) & 0x07ff) == 0x0096)
+#define INKING_PEN(ds)  ((((ds)->device_id) & 0x07ff) == 0x0012)
+#define STYLUS_TOOL(ds) (PEN(ds) || STROKING_PEN(ds) || INKING_PEN(ds) || \
+			AIRBRUSH(ds))
+#define CURSOR_TOOL(ds) (MOUSE_4D(ds) || LENS_CURSOR(ds) || MOUSE_2D(ds))
+
+struct _WacomDeviceState
+{
+	LocalDevicePtr local;
+	int device_id;		/* tool id reported from the physical device */
+	int device_type;
+	unsigned int serial_num;
+	int x;
+	int y;
+	int buttons;
+	int pressure;
+	int capacity;
+	int tiltx;
+	int tilty;
+	int stripx;
+	int stripy;
+	int rotation;
+	int abswheel;
+	int relwheel;
+	int distance;
+	int throttle;
+	int discard_first;
+	int proximity;
+	int sample;	/* wraps every 24 days */
+	int64_t time_us; /* when the tablet reported it, in microseconds
+			  * of CLOCK_MONOTONIC, 0 if unknown */
+	int changed;	/* WCM_CHANGED_* fields that may differ from the
+			 * last valid state */
+};
+
+/* WacomDeviceState.changed bits, set by the parsers. A clear bit
+ * guarantees the field still holds its last valid value. */
+#define WCM_CHANGED_X		0x0001
+#define WCM_CHANGED_Y		0x0002
+#define WCM_CHANGED_PRESSURE	0x0004
+#define WCM_CHANGED_CAPACITY	0x0008
+#define WCM_CHANGED_TILT	0x0010
+#define WCM_CHANGED_ROTATION	0x0020
+#define WCM_CHANGED_THROTTLE	0x0040
+#define WCM_CHANGED_WHEEL	0x0080	/* absolute or relative */
+#define WCM_CHANGED_STRIP	0x0100
+#define WCM_CHANGED_DISTANCE	0x0200
+#define WCM_CHANGED_BUTTONS	0x0400
+#define WCM_CHANGED_TOOL	0x0800	/* type, id, serial or proximity */
+#define WCM_CHANGED_ALL		0x0fff
+
+struct _WacomFilterState
+{
+        int npoints;
+        int size;               /* samples in the ring, wcmRawSample */
+        int pos;                /* slot of the newest sample */
+        int x[MAX_SAMPLES];     /* rings of the last size samples */
+        int y[MAX_SAMPLES];
+        int tiltx[MAX_SAMPLES];
+        int tilty[MAX_SAMPLES];
+        int sumx, sumy;         /* sums of what the rings hold */
+        int sumtiltx, sumtilty;
+        int statex;
+        int statey;
+        int tiltsettled;        /* unchanged tilt samples in a row */
+};
+
+struct _WacomChannel
+{
+	/* data stored in this structure is raw data from the tablet, prior
+	 * to transformation and user-defined filtering. Suppressed values
+	 * will not be included here, and hardware filtering may occur between
+	 * the work stage and the valid state. */
+
+	WacomDeviceState work;                         /* next state */
+
+	/* the following union contains the current known state of the
+	 * device channel, as well as the previous MAX_SAMPLES states
+	 * for use in detecting hardware defects, jitter, trends, etc. */
+	union
+	{
+		WacomDeviceState state;                /* current state */
+		WacomDeviceState states[MAX_SAMPLES];  /* states 0..MAX */
+	} valid;
+
+	int nSamples;
+	WacomFilterState rawFilter;
+	int changed;            /* WCM_CHANGED_* bits not yet in valid */
+	int coalesce;           /* if set, valid.state is motion held back
+	                         * while overloaded; the suppress to send it */
+};
+
 /******************************************************************************
  * WacomDeviceRec
  *****************************************************************************/
@@ -248,6 +398,16 @@ struct _WacomDeviceRec
 	int throttleLimit;      /* time in ticks for next wheel movement */
 	int throttleValue;      /* current throttle value */
 
+	/* output rate limit */
+	int maxEventRate;       /* motion events per second, 0 for no limit */
+	int64_t lastEventTime;  /* when motion was last posted, in us */
+	int eventHeld;          /* heldState waits for eventTimer */
+	int64_t eventDue;       /* when heldState may be posted, in us */
+	WacomDeviceState heldState; /* latest motion held back */
+	OsTimerPtr eventTimer;  /* posts heldState, allocated with the device */
+	int eventArmed;         /* eventTimer is set, see wcmHeldBlockHandler */
+	int64_t hoverTime;      /* time_us of the last state posted */
+
 	/* JEJ - filters */
 	int* pPressCurve;       /* pressure curve */
 	int nPressCtrl[4];      /* control points for curve */
@@ -257,99 +417,65 @@ struct _WacomDeviceRec
 
 	int isParent;		/* set to 1 if the device is not auto-hotplugged */
 	Atom btn_actions[WCM_MAX_BUTTONS]; /* property handlers to listen to */
+	unsigned int posted[WCM_POSTED]; /* events posted, by type */
 };
 
 /******************************************************************************
- * WacomDeviceState
+ * WacomDeviceClass
  *****************************************************************************/
 
-#define MAX_SAMPLES	20
-#define DEFAULT_SAMPLES 4
-
-#define PEN(ds)         ((((ds)->device_id) & 0x07ff) == 0x0022 || \
-                         (((ds)->device_id) & 0x07ff) == 0x0042 || \
-                         (((ds)->device_id) & 0x07ff) == 0x0052)
-#define STROKING_PEN(ds) ((((ds)->device_id) & 0x07ff) == 0x0032)
-#define AIRBRUSH(ds)    ((((ds)->device_id) & 0x07ff) == 0x0112)
-#define MOUSE_4D(ds)    ((((ds)->device_id) & 0x07ff) == 0x0094)
-#define MOUSE_2D(ds)    ((((ds)->device_id) & 0x07ff) == 0x0007)
-#define LENS_CURSOR(ds) ((((ds)->device_id) & 0x07ff) == 0x0096)
-#define INKING_PEN(ds)  ((((ds)->device_id) & 0x07ff) == 0x0012)
-#define STYLUS_TOOL(ds) (PEN(ds) || STROKING_PEN(ds) || INKING_PEN(ds) || \
-			AIRBRUSH(ds))
-#define CURSOR_TOOL(ds) (MOUSE_4D(ds) || LENS_CURSOR(ds) || MOUSE_2D(ds))
-
-struct _WacomDeviceState
-{
-	LocalDevicePtr local;
-	int device_id;		/* tool id reported from the physical device */
-	int device_type;
-	unsigned int serial_num;
-	int x;
-	int y;
-	int buttons;
-	int pressure;
-	int capacity;
-	int tiltx;
-	int tilty;
-	int stripx;
-	int stripy;
-	int rotation;
-	int abswheel;
-	int relwheel;
-	int distance;
-	int throttle;
-	int discard_first;
-	int proximity;
-	int sample;	/* wraps every 24 days */
-};
-
-struct _WacomFilterState
+struct _WacomDeviceClass
 {
-        int npoints;
-        int x[MAX_SAMPLES];
-        int y[MAX_SAMPLES];
-        int tiltx[MAX_SAMPLES];
-        int tilty[MAX_SAMPLES];
-        int statex;
-        int statey;
+	Bool (*Detect)(LocalDevicePtr local); /* detect device */
+	Bool (*Init)(LocalDevicePtr local, char* id, float *version);   /* initialize device */
+	int (*Read)(LocalDevicePtr local);    /* reads device, returns bytes read,
+	                                       * 0 if nothing is pending, -1 on error */
 };
 
-struct _WacomChannel
-{
-	/* data stored in this structure is raw data from the tablet, prior
-	 * to transformation and user-defined filtering. Suppressed values
-	 * will not be included here, and hardware filtering may occur between
-	 * the work stage and the valid state. */
+	extern WacomDeviceClass gWacomUSBDevice;
+	extern WacomDeviceClass gWacomISDV4Device;
 
-	WacomDeviceState work;                         /* next state */
+/******************************************************************************
+ * WacomEventMap - USB event decoding, one entry per EV_ABS or EV_KEY code
+ *****************************************************************************/
 
-	/* the following union contains the current known state of the
-	 * device channel, as well as the previous MAX_SAMPLES states
-	 * for use in detecting hardware defects, jitter, trends, etc. */
-	union
-	{
-		WacomDeviceState state;                /* current state */
-		WacomDeviceState states[MAX_SAMPLES];  /* states 0..MAX */
-	} valid;
+typedef struct _WacomEventMap WacomEventMap;
 
-	int nSamples;
-	WacomFilterState rawFilter;
+struct _WacomEventMap
+{
+	unsigned char handler;  /* how to decode it, see wcmUSB.c */
+	unsigned char arg;      /* state field offset, button or tool type */
+	unsigned short changed; /* WCM_CHANGED_* bits the code updates */
 };
 
 /******************************************************************************
- * WacomDeviceClass
+ * Pipeline stages, timed with wcmStageEnter/wcmStageLeave while
+ * common->wcmTiming is set
  *****************************************************************************/
 
-struct _WacomDeviceClass
+#define WCM_STAGE_READ      0   /* read() of the device */
+#define WCM_STAGE_PARSE     1   /* the model's Parse */
+#define WCM_STAGE_FILTER    2   /* wcmEvent: raw filter, suppression */
+#define WCM_STAGE_DISPATCH  3   /* commonDispatchDevice: tool and area */
+#define WCM_STAGE_POST      4   /* posting the events of a state */
+#define WCM_STAGES          5
+
+/* latency histogram: bucket 0 is < 1us, bucket n is [2^(n-1), 2^n) us,
+ * the last bucket takes everything above */
+#define WCM_LATENCY_BUCKETS 16
+
+typedef struct
 {
-	Bool (*Detect)(LocalDevicePtr local); /* detect device */
-	Bool (*Init)(LocalDevicePtr local, char* id, float *version);   /* initialize device */
-	void (*Read)(LocalDevicePtr local);   /* reads device */
-};
+	int64_t start;          /* when the stage was entered, in ns */
+	int64_t nested;         /* time the caller spent in nested stages */
+} WacomStageMark;
 
-	extern WacomDeviceClass gWacomUSBDevice;
-	extern WacomDeviceClass gWacomISDV4Device;
+typedef struct
+{
+	unsigned long count;    /* times the stage ran */
+	int64_t ns;             /* time in it, nested stages not included */
+	unsigned int hist[WCM_LATENCY_BUCKETS]; /* runs by exclusive time */
+} WacomStageTime;
 
 /******************************************************************************
  * WacomCommonRec
@@ -363,6 +489,8 @@ struct _WacomDeviceClass
 */
 #define USE_SYN_REPORTS_FLAG	8
 #define AUTODEV_FLAG		16
+/* set if the kernel stamps USB events with CLOCK_MONOTONIC */
+#define MONOTONIC_TIME_FLAG	32
 
 #define DEVICE_ISDV4 		0x000C
 
@@ -440,13 +568,49 @@ struct _WacomCommonRec
 	int wcmSuppress;        	 /* transmit position on delta > supress */
 	int wcmRawSample;	     /* Number of raw data used to filter an event */
 	int wcmScaling;		     /* dealing with missing calling DevConvert case. Default 0 */
+	int wcmReadBudget;	     /* max number of reads per wakeup */
+	unsigned int wcmReadBudgetHits; /* wakeups that exhausted wcmReadBudget */
+
+	WacomRing wcmRing;                 /* unparsed data read from device */
+	int64_t wcmRecvTime;               /* time of the last read, see time_us */
+	unsigned char buffer[RECV_BUFFER_SIZE + RING_MIRROR_SIZE]; /* its storage */
 
-	int bufpos;                        /* position with buffer */
-	unsigned char buffer[BUFFER_SIZE]; /* data read from device */
+	WacomEventMap wcmAbsMap[ABS_MAX + 1]; /* EV_ABS decoding, set at usbWcmInit */
+	WacomEventMap wcmKeyMap[KEY_MAX + 1]; /* EV_KEY decoding, incl. pad keys */
 
 	int wcmLastToolSerial;
 	int wcmEventCnt;
-	struct input_event wcmEvents[MAX_USB_EVENTS];  /* events for current change */
+	int wcmEventMax;             /* size of wcmEvents, set at usbWcmInit */
+	struct input_event* wcmEvents; /* staged events of a frame
+	                                * straddling two reads */
+	int wcmResync;               /* SYN_DROPPED seen, skip to SYN_REPORT */
+	WacomCommonPtr* wcmLostPending; /* slot of the queued wcmDeviceLost,
+	                              * see wcmDeviceLostLater */
+
+	int wcmThreaded;             /* read the device in a thread */
+	WacomThreadPtr wcmThread;    /* that thread, while it runs */
+	unsigned int wcmQueueStalls; /* thread waits for the X server */
+	unsigned int wcmQueueOverflows; /* states the thread had to drop */
+	unsigned int wcmNotes[WCM_NOTES]; /* WCM_NOTE_* seen by the thread */
+	int wcmShared;               /* read by the shared reader */
+	LocalDevicePtr wcmReactorLocal; /* device it reads for, if it does */
+	int wcmOverloadThreshold;    /* full reads in a row that mean we're
+	                              * behind, 0 never coalesces */
+	int wcmFullReads;            /* full reads in a row so far */
+	int wcmOverload;             /* behind, coalescing motion */
+	unsigned int wcmCoalesced;   /* motion states merged into newer ones */
+	int wcmHoverRate;            /* max hover states per second, 0 for all */
+	unsigned int wcmHoverDecimated; /* hover states dropped for it */
+	char* wcmRecordFile;         /* record what is read to this file */
+	WacomRecorderPtr wcmRecorder; /* the recorder, while the tablet is open */
+	char* wcmTraceFile;          /* where the debug trace is dumped to */
+	int wcmTiming;               /* time the pipeline stages */
+	WacomStageTime wcmStages[2][WCM_STAGES]; /* where the time goes, by
+	                              * wcmReaderThread; see wcmStageSum */
+	unsigned int wcmStats[WCM_STATS]; /* WCM_STAT_* counts since open */
+	unsigned int wcmStatsBase[WCM_STATS]; /* wcmStats at the last reset;
+	                              * the reader thread may be counting, so
+	                              * a reset doesn't touch wcmStats */
 
 	WacomToolPtr wcmTool; /* List of unique tools */
 };